@@ -5,8 +5,12 @@
 
 void init_actor(struct actor *a, const char *fn, int w, int h, const struct anim_info *info)
 {
-  a->spr = load_sprite(fn, w, h);
-  if (a->spr == NULL)
+  /* Sheets are shared and load in the background, sessions that are not
+     drawn have none */
+  a->spr = NULL;
+  if (session->render)
+    a->spr = get_sprite(fn, w, h, SPRITE_ASYNC | SPRITE_PACKED);
+  if (session->render && a->spr == NULL)
   {
     printf("Fatal Error -- Unable to load sprite: %s\n", fn);
     exit(1);
@@ -21,7 +25,7 @@ void init_actor(struct actor *a, const char *fn, int w, int h, const struct anim
   a->rev_anim = FALSE;
   a->counter = 0;
 
-  memcpy(&a->anim_info, info, sizeof(struct anim_info));
+  a->anim_info = info;
 }
 
 void set_dir_actor(struct actor *a, enum facing dir)
@@ -33,19 +37,19 @@ void set_dir_actor(struct actor *a, enum facing dir)
   switch (dir)
   {
     case LEFT:
-      a->base_frame = a->anim_info.left;
+      a->base_frame = a->anim_info->left;
       break;
 
     case RIGHT:
-      a->base_frame = a->anim_info.right;
+      a->base_frame = a->anim_info->right;
       break;
 
     case UP:
-      a->base_frame = a->anim_info.up;
+      a->base_frame = a->anim_info->up;
       break;
 
     case DOWN:
-      a->base_frame = a->anim_info.down;
+      a->base_frame = a->anim_info->down;
       break;
 
     default:
@@ -56,13 +60,13 @@ void set_dir_actor(struct actor *a, enum facing dir)
 
 void animate_walk_actor(struct actor *a)
 {
-  if (++a->counter == a->anim_info.treshold)
+  if (++a->counter == a->anim_info->treshold)
   {
     if (!a->rev_anim)
     {
-      if (++a->delta_frame > a->anim_info.num_walk_frames - 1)
+      if (++a->delta_frame > a->anim_info->num_walk_frames - 1)
       {
-        a->delta_frame = a->anim_info.num_walk_frames - 1;
+        a->delta_frame = a->anim_info->num_walk_frames - 1;
         a->rev_anim = TRUE;
       }
     }
@@ -115,7 +119,7 @@ void animate_move_actor(struct actor *a)
 
     if (a->dx)
     {
-      a->x += a->dx * a->anim_info.speed;
+      a->x += a->dx * a->anim_info->speed;
       if ((a->x % TILE_WIDTH) == 0)
       {
         a->dx = 0;
@@ -126,7 +130,7 @@ void animate_move_actor(struct actor *a)
 
     if (a->dy)
     {
-      a->y += a->dy * a->anim_info.speed;
+      a->y += a->dy * a->anim_info->speed;
       if ((a->y % TILE_HEIGHT) == 0)
       {
         a->dy = 0;
@@ -165,19 +169,19 @@ void set_attack_actor(struct actor *a, enum facing dir)
   switch (dir)
   {
     case LEFT:
-      a->base_frame = a->anim_info.attack_left;
+      a->base_frame = a->anim_info->attack_left;
       break;
 
     case RIGHT:
-      a->base_frame = a->anim_info.attack_right;
+      a->base_frame = a->anim_info->attack_right;
       break;
 
     case UP:
-      a->base_frame = a->anim_info.attack_up;
+      a->base_frame = a->anim_info->attack_up;
       break;
 
     case DOWN:
-      a->base_frame = a->anim_info.attack_down;
+      a->base_frame = a->anim_info->attack_down;
       break;
 
     default:
@@ -190,9 +194,9 @@ void animate_attack_actor(struct actor *a)
 {
   if (a->act == ATTACK)
   {
-    if (++a->counter == a->anim_info.treshold)
+    if (++a->counter == a->anim_info->treshold)
     {
-      if (++a->delta_frame > a->anim_info.num_attack_frames - 1)
+      if (++a->delta_frame > a->anim_info->num_attack_frames - 1)
       {
         set_dir_actor(a, a->dir);
         a->act = IDLE;
@@ -217,9 +221,16 @@ void face_target_actor(struct actor *a, struct actor *target)
 
 void draw_actor(struct actor *a)
 {
-  draw_sprite(a->x - a->anim_info.anchor_x - d.map_x,
-              a->y - a->anim_info.anchor_y - d.map_y,
-              a->base_frame + a->delta_frame, a->spr,
-              0, 0, screen_width, screen_height);
+  int x = a->x - a->anim_info->anchor_x;
+  int y = a->y - a->anim_info->anchor_y;
+
+  /* Actors out of view are not queued at all */
+  if (!camera_sees(&session->camera, x, y, a->spr->w, a->spr->h))
+    return;
+
+  queue_sprite(a == &d.pa ? LAYER_PLAYER : LAYER_ACTORS,
+               x - session->camera.x, y - session->camera.y,
+               a->base_frame + a->delta_frame, a->spr,
+               0, 0, screen_width, screen_height);
 }
 
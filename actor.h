@@ -39,8 +39,8 @@ struct actor
   /* Actor action */
   enum action act;
 
-  /* Animation information */
-  struct anim_info anim_info;
+  /* Animation information, shared by actors of a kind */
+  const struct anim_info *anim_info;
 
   /* Animation idle counter */
   int counter;
@@ -0,0 +1,372 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * blit.c -- 32 bit pixel kernels
+ *
+ * Loops over rows of 32 bit pixels in the screen layout.  They keep no
+ * state and never lock, so several threads may run them on disjoint parts
+ * of one surface.
+ *
+ * On x86 the blend and color key kernels have SSE2 and AVX2 versions, and
+ * the integer scaler an SSE2 version, picked once by select_blit().  They
+ * give exactly the same pixels as the plain versions: blend_pixel works
+ * on each channel separately, so it is done the same way in 16 bit
+ * lanes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blit.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLIT_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*blend_row_fn)(uint32_t *dst, const uint32_t *src, int w,
+                             int ashift);
+typedef void (*key_row_fn)(uint32_t *dst, const uint32_t *src, int w,
+                           uint32_t key, uint32_t mask);
+typedef void (*scale_row_fn)(uint32_t *dst, const uint32_t *src, int w,
+                             int n);
+
+static void blend_row(uint32_t *dst, const uint32_t *src, int w, int ashift)
+{
+  uint32_t s, a;
+  int i;
+
+  for (i = 0; i < w; i++)
+  {
+    s = src[i];
+    a = s >> ashift & 0xff;
+
+    /* Most pixels are either fully clear or fully opaque */
+    if (a == 255)
+      dst[i] = s;
+    else if (a)
+      dst[i] = blend_pixel(s, dst[i], a);
+  }
+}
+
+static void key_row(uint32_t *dst, const uint32_t *src, int w,
+                    uint32_t key, uint32_t mask)
+{
+  int i;
+
+  for (i = 0; i < w; i++)
+    if ((src[i] & mask) != key)
+      dst[i] = src[i];
+}
+
+static void scale_row(uint32_t *dst, const uint32_t *src, int w, int n)
+{
+  int i, j;
+
+  for (i = 0; i < w; i++)
+    for (j = 0; j < n; j++)
+      *dst++ = src[i];
+}
+
+#ifdef BLIT_X86
+
+/* Blend two pixels in 16 bit lanes, alpha is already in every lane */
+#define BLEND_LANES(s, d, a, inv, mul, add, srl)			\
+  srl(add(mul(s, a), mul(d, inv)), 8)
+
+__attribute__((target("sse2")))
+static void blend_row_sse2(uint32_t *dst, const uint32_t *src, int w,
+                           int ashift)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i ff = _mm_set1_epi32(0xff);
+  __m128i full = _mm_set1_epi16(256);
+  __m128i count = _mm_cvtsi32_si128(ashift);
+  __m128i s, d, a, lo, hi, alo, ahi;
+  int i, m;
+
+  for (i = 0; i + 4 <= w; i += 4)
+  {
+    s = _mm_loadu_si128((const __m128i *) (src + i));
+    a = _mm_and_si128(_mm_srl_epi32(s, count), ff);
+
+    /* Skip four clear pixels, copy four opaque ones */
+    m = _mm_movemask_epi8(_mm_cmpeq_epi32(a, zero));
+    if (m == 0xffff)
+      continue;
+    m = _mm_movemask_epi8(_mm_cmpeq_epi32(a, ff));
+    if (m == 0xffff)
+    {
+      _mm_storeu_si128((__m128i *) (dst + i), s);
+      continue;
+    }
+
+    d = _mm_loadu_si128((const __m128i *) (dst + i));
+    a = _mm_add_epi32(a, _mm_srli_epi32(a, 7));
+    a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+    alo = _mm_unpacklo_epi32(a, a);
+    ahi = _mm_unpackhi_epi32(a, a);
+
+    lo = BLEND_LANES(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero),
+                     alo, _mm_sub_epi16(full, alo),
+                     _mm_mullo_epi16, _mm_add_epi16, _mm_srli_epi16);
+    hi = BLEND_LANES(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero),
+                     ahi, _mm_sub_epi16(full, ahi),
+                     _mm_mullo_epi16, _mm_add_epi16, _mm_srli_epi16);
+    _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+  }
+
+  blend_row(dst + i, src + i, w - i, ashift);
+}
+
+__attribute__((target("avx2")))
+static void blend_row_avx2(uint32_t *dst, const uint32_t *src, int w,
+                           int ashift)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i ff = _mm256_set1_epi32(0xff);
+  __m256i full = _mm256_set1_epi16(256);
+  __m128i count = _mm_cvtsi32_si128(ashift);
+  __m256i s, d, a, lo, hi, alo, ahi;
+  int i, m;
+
+  for (i = 0; i + 8 <= w; i += 8)
+  {
+    s = _mm256_loadu_si256((const __m256i *) (src + i));
+    a = _mm256_and_si256(_mm256_srl_epi32(s, count), ff);
+
+    /* Skip eight clear pixels, copy eight opaque ones */
+    m = _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, zero));
+    if (m == -1)
+      continue;
+    m = _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, ff));
+    if (m == -1)
+    {
+      _mm256_storeu_si256((__m256i *) (dst + i), s);
+      continue;
+    }
+
+    /* Unpacking stays within 128 bit halves, for pixels and alpha alike */
+    d = _mm256_loadu_si256((const __m256i *) (dst + i));
+    a = _mm256_add_epi32(a, _mm256_srli_epi32(a, 7));
+    a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+    alo = _mm256_unpacklo_epi32(a, a);
+    ahi = _mm256_unpackhi_epi32(a, a);
+
+    lo = BLEND_LANES(_mm256_unpacklo_epi8(s, zero),
+                     _mm256_unpacklo_epi8(d, zero),
+                     alo, _mm256_sub_epi16(full, alo),
+                     _mm256_mullo_epi16, _mm256_add_epi16, _mm256_srli_epi16);
+    hi = BLEND_LANES(_mm256_unpackhi_epi8(s, zero),
+                     _mm256_unpackhi_epi8(d, zero),
+                     ahi, _mm256_sub_epi16(full, ahi),
+                     _mm256_mullo_epi16, _mm256_add_epi16, _mm256_srli_epi16);
+    _mm256_storeu_si256((__m256i *) (dst + i), _mm256_packus_epi16(lo, hi));
+  }
+
+  /* Leave the upper halves clean before running SSE code */
+  _mm256_zeroupper();
+  blend_row_sse2(dst + i, src + i, w - i, ashift);
+}
+
+__attribute__((target("sse2")))
+static void key_row_sse2(uint32_t *dst, const uint32_t *src, int w,
+                         uint32_t key, uint32_t mask)
+{
+  __m128i k = _mm_set1_epi32(key), m = _mm_set1_epi32(mask);
+  __m128i s, d, hit;
+  int i;
+
+  for (i = 0; i + 4 <= w; i += 4)
+  {
+    s = _mm_loadu_si128((const __m128i *) (src + i));
+    d = _mm_loadu_si128((const __m128i *) (dst + i));
+    hit = _mm_cmpeq_epi32(_mm_and_si128(s, m), k);
+    _mm_storeu_si128((__m128i *) (dst + i),
+                     _mm_or_si128(_mm_and_si128(hit, d),
+                                  _mm_andnot_si128(hit, s)));
+  }
+
+  key_row(dst + i, src + i, w - i, key, mask);
+}
+
+__attribute__((target("avx2")))
+static void key_row_avx2(uint32_t *dst, const uint32_t *src, int w,
+                         uint32_t key, uint32_t mask)
+{
+  __m256i k = _mm256_set1_epi32(key), m = _mm256_set1_epi32(mask);
+  __m256i s, d;
+  int i;
+
+  for (i = 0; i + 8 <= w; i += 8)
+  {
+    s = _mm256_loadu_si256((const __m256i *) (src + i));
+    d = _mm256_loadu_si256((const __m256i *) (dst + i));
+    _mm256_storeu_si256((__m256i *) (dst + i),
+                        _mm256_blendv_epi8(s, d,
+                          _mm256_cmpeq_epi32(_mm256_and_si256(s, m), k)));
+  }
+
+  _mm256_zeroupper();
+  key_row_sse2(dst + i, src + i, w - i, key, mask);
+}
+
+/* Repeat four pixels at a time, 3x is three shuffles of the same four */
+__attribute__((target("sse2")))
+static void scale_row_sse2(uint32_t *dst, const uint32_t *src, int w, int n)
+{
+  __m128i s;
+  int i;
+
+  if (n < 2 || n > 4)
+  {
+    scale_row(dst, src, w, n);
+    return;
+  }
+
+  for (i = 0; i + 4 <= w; i += 4, dst += 4 * n)
+  {
+    s = _mm_loadu_si128((const __m128i *) (src + i));
+
+    switch (n)
+    {
+      case 2:
+        _mm_storeu_si128((__m128i *) dst, _mm_unpacklo_epi32(s, s));
+        _mm_storeu_si128((__m128i *) dst + 1, _mm_unpackhi_epi32(s, s));
+        break;
+      case 3:
+        _mm_storeu_si128((__m128i *) dst, _mm_shuffle_epi32(s, 0x40));
+        _mm_storeu_si128((__m128i *) dst + 1, _mm_shuffle_epi32(s, 0xa5));
+        _mm_storeu_si128((__m128i *) dst + 2, _mm_shuffle_epi32(s, 0xfe));
+        break;
+      default:
+        _mm_storeu_si128((__m128i *) dst, _mm_shuffle_epi32(s, 0x00));
+        _mm_storeu_si128((__m128i *) dst + 1, _mm_shuffle_epi32(s, 0x55));
+        _mm_storeu_si128((__m128i *) dst + 2, _mm_shuffle_epi32(s, 0xaa));
+        _mm_storeu_si128((__m128i *) dst + 3, _mm_shuffle_epi32(s, 0xff));
+        break;
+    }
+  }
+
+  scale_row(dst, src + i, w - i, n);
+}
+
+#endif
+
+static blend_row_fn blend_kernel = blend_row;
+static key_row_fn key_kernel = key_row;
+static scale_row_fn scale_kernel = scale_row;
+
+const char *select_blit(void)
+{
+  const char *want = getenv("EDOM_BLIT");
+
+  blend_kernel = blend_row;
+  key_kernel = key_row;
+  scale_kernel = scale_row;
+
+  /* EDOM_BLIT caps the instruction set, for comparing the kernels */
+  if (want != NULL && strcmp(want, "scalar") == 0)
+    return "scalar";
+
+#ifdef BLIT_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse2"))
+    scale_kernel = scale_row_sse2;
+
+  if (__builtin_cpu_supports("avx2") &&
+      (want == NULL || strcmp(want, "avx2") == 0))
+  {
+    blend_kernel = blend_row_avx2;
+    key_kernel = key_row_avx2;
+    return "avx2";
+  }
+
+  if (__builtin_cpu_supports("sse2"))
+  {
+    blend_kernel = blend_row_sse2;
+    key_kernel = key_row_sse2;
+    return "sse2";
+  }
+#endif
+
+  return "scalar";
+}
+
+void blit_copy32(uint32_t *dst, int dpitch,
+                 const uint32_t *src, int spitch, int w, int h)
+{
+  while (h--)
+  {
+    memcpy(dst, src, w * sizeof(uint32_t));
+    dst = (uint32_t *) ((unsigned char *) dst + dpitch);
+    src = (const uint32_t *) ((const unsigned char *) src + spitch);
+  }
+}
+
+void blit_blend32(uint32_t *dst, int dpitch,
+                  const uint32_t *src, int spitch, int w, int h, int ashift)
+{
+  while (h--)
+  {
+    blend_kernel(dst, src, w, ashift);
+    dst = (uint32_t *) ((unsigned char *) dst + dpitch);
+    src = (const uint32_t *) ((const unsigned char *) src + spitch);
+  }
+}
+
+void blit_key32(uint32_t *dst, int dpitch,
+                const uint32_t *src, int spitch, int w, int h,
+                uint32_t key, uint32_t mask)
+{
+  key &= mask;
+
+  while (h--)
+  {
+    key_kernel(dst, src, w, key, mask);
+    dst = (uint32_t *) ((unsigned char *) dst + dpitch);
+    src = (const uint32_t *) ((const unsigned char *) src + spitch);
+  }
+}
+
+void blit_scale32(uint32_t *dst, int dpitch,
+                  const uint32_t *src, int spitch, int w, int h, int n)
+{
+  uint32_t *row;
+  int i;
+
+  while (h--)
+  {
+    /* Scale one row, then repeat it */
+    scale_kernel(dst, src, w, n);
+    row = dst;
+    for (i = 1; i < n; i++)
+    {
+      dst = (uint32_t *) ((unsigned char *) dst + dpitch);
+      memcpy(dst, row, w * n * sizeof(uint32_t));
+    }
+
+    dst = (uint32_t *) ((unsigned char *) dst + dpitch);
+    src = (const uint32_t *) ((const unsigned char *) src + spitch);
+  }
+}
@@ -0,0 +1,64 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * blit.h -- 32 bit pixel kernels
+ * header for blit.c
+ */
+
+#ifndef _blit_h
+#define _blit_h
+
+#include <stdint.h>
+
+/*
+ * Blend a pixel onto another, two 8 bit channels at a time.  Only the
+ * three color channels are meaningful, the fourth byte of the result is
+ * undefined.
+ */
+
+static inline uint32_t blend_pixel(uint32_t s, uint32_t d, uint32_t a)
+{
+  a += a >> 7;
+  return ((((s & 0xff00ff) * a + (d & 0xff00ff) * (256 - a)) >> 8) & 0xff00ff) |
+         (((s >> 8 & 0xff00ff) * a + (d >> 8 & 0xff00ff) * (256 - a)) &
+          0xff00ff00);
+}
+
+/*
+ * Pitches are in bytes, ashift is the position of the source alpha.  The
+ * color key is compared on the bits in mask only.
+ */
+extern const char *select_blit(void);
+extern void blit_copy32(uint32_t *dst, int dpitch,
+                        const uint32_t *src, int spitch, int w, int h);
+extern void blit_blend32(uint32_t *dst, int dpitch,
+                         const uint32_t *src, int spitch, int w, int h,
+                         int ashift);
+extern void blit_key32(uint32_t *dst, int dpitch,
+                       const uint32_t *src, int spitch, int w, int h,
+                       uint32_t key, uint32_t mask);
+
+/* Nearest neighbour, every source pixel becomes an n by n block */
+extern void blit_scale32(uint32_t *dst, int dpitch,
+                         const uint32_t *src, int spitch, int w, int h,
+                         int n);
+
+#endif
@@ -0,0 +1,266 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * broadcast.c -- spectators of the game on screen
+ *
+ * A game started with -B writes a frame of what is on screen into shared
+ * memory once per tick, encoded against the tick before (see proto.c).
+ * Every KEYFRAME_INTERVAL ticks the frame is a keyframe instead.  Any
+ * number of spectators started with -V map the same memory read only and
+ * decode the frames on their own; the game does the same work however
+ * many are watching.  Spectators start at the newest keyframe and
+ * decode forward from it.  A spectator that falls so far behind that
+ * frames were overwritten waits for the next keyframe.
+ *
+ * Each slot of the ring is guarded by a sequence number that is odd
+ * while the game writes the slot.  A spectator copies a frame out and
+ * keeps it only if the sequence number did not change meanwhile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ctrl.h"
+#include "session.h"
+#include "net.h"
+#include "broadcast.h"
+
+#if BROADCAST_SLOTS <= KEYFRAME_INTERVAL
+#error "The ring must hold a keyframe and every frame after it"
+#endif
+
+static struct broadcast *bc;
+static char bc_name[64];
+static struct view bc_view[2];
+
+/* Shared memory names start with a slash */
+static BOOL shm_name(const char *name, char *buf, int size)
+{
+  if (snprintf(buf, size, "%s%s", name[0] == '/' ? "" : "/", name) >= size) {
+    fprintf(stderr, "Broadcast name too long: %s\n", name);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Broadcast the game on screen under 'name'.
+ */
+
+BOOL open_broadcast(const char *name)
+{
+  void *p;
+  int fd;
+
+  if (!shm_name(name, bc_name, sizeof(bc_name)))
+    return FALSE;
+
+  fd = shm_open(bc_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(bc_name);
+    return FALSE;
+  }
+
+  if (ftruncate(fd, sizeof(struct broadcast)) < 0) {
+    perror(bc_name);
+    close(fd);
+    shm_unlink(bc_name);
+    return FALSE;
+  }
+
+  p = mmap(NULL, sizeof(struct broadcast), PROT_READ | PROT_WRITE,
+           MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror(bc_name);
+    shm_unlink(bc_name);
+    return FALSE;
+  }
+
+  bc = p;
+  __atomic_store_n(&bc->magic, BROADCAST_MAGIC, __ATOMIC_RELEASE);
+
+  return TRUE;
+}
+
+/*
+ * Publish a frame of the current session.  Called once per tick.
+ */
+
+void broadcast_view(void)
+{
+  struct broadcast_slot *s;
+  struct view *v, *base = NULL;
+  uint32 tick;
+
+  if (bc == NULL)
+    return;
+
+  tick = bc->head + 1;
+  v = &bc_view[tick & 1];
+  capture_view(v);
+  v->tick = tick;
+
+  if ((tick - 1) % KEYFRAME_INTERVAL != 0)
+    base = &bc_view[(tick - 1) & 1];
+
+  s = &bc->slot[tick % BROADCAST_SLOTS];
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  s->len = encode_frame(base, v, s->data);
+  s->tick = tick;
+
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+
+  if (base == NULL)
+    __atomic_store_n(&bc->keyframe, tick, __ATOMIC_RELEASE);
+  __atomic_store_n(&bc->head, tick, __ATOMIC_RELEASE);
+}
+
+void close_broadcast(void)
+{
+  if (bc == NULL)
+    return;
+
+  __atomic_store_n(&bc->done, TRUE, __ATOMIC_RELEASE);
+  munmap(bc, sizeof(struct broadcast));
+  shm_unlink(bc_name);
+  bc = NULL;
+}
+
+/* Copy the frame of 'tick' out of the ring, FALSE if it is gone */
+static BOOL read_slot(const struct broadcast *b, uint32 tick,
+                      unsigned char *buf, int *len)
+{
+  const struct broadcast_slot *s = &b->slot[tick % BROADCAST_SLOTS];
+  uint32 seq;
+
+  seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+  if ((seq & 1) || s->tick != tick)
+    return FALSE;
+
+  *len = s->len;
+  if (*len <= 0 || *len > MAX_FRAME_LEN)
+    return FALSE;
+  memcpy(buf, s->data, *len);
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq;
+}
+
+/*
+ * Watch the game broadcast under 'name'.  The current session only
+ * provides the tile map, sprites and status line.
+ */
+
+int run_viewer(const char *name)
+{
+  unsigned char buf[MAX_FRAME_LEN];
+  char path[64];
+  const struct broadcast *b;
+  struct view *ring, *shown, *v;
+  uint32 next = 0, latest = 0;
+  unsigned long lost = 0;
+  int fd, len, held, pressed;
+  void *p;
+
+  if (!shm_name(name, path, sizeof(path)))
+    return 1;
+
+  fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0) {
+    perror(path);
+    return 1;
+  }
+
+  p = mmap(NULL, sizeof(struct broadcast), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror(path);
+    return 1;
+  }
+
+  b = p;
+  if (__atomic_load_n(&b->magic, __ATOMIC_ACQUIRE) != BROADCAST_MAGIC) {
+    fprintf(stderr, "%s is not a broadcast\n", path);
+    return 1;
+  }
+
+  ring = calloc(VIEW_RING, sizeof(struct view));
+  shown = calloc(1, sizeof(struct view));
+  if (ring == NULL || shown == NULL) {
+    fprintf(stderr, "Fatal Error -- Out of memory\n");
+    return 1;
+  }
+
+  for (;;)
+  {
+    pump_input();
+    take_input(SDL_GetTicks(), &held, &pressed);
+    if (held & PRESS_ESC)
+      break;
+
+    if (pressed & PRESS_LOG)
+      scroll_messages();
+
+    /* Join, or join again, at the newest keyframe */
+    if (next == 0)
+      next = __atomic_load_n(&b->keyframe, __ATOMIC_ACQUIRE);
+
+    while (next && next <= __atomic_load_n(&b->head, __ATOMIC_ACQUIRE))
+    {
+      if (!read_slot(b, next, buf, &len) ||
+          (v = decode_frame(buf, len, ring)) == NULL)
+      {
+        lost++;
+        next = 0;
+        break;
+      }
+
+      latest = v->tick;
+      next++;
+    }
+
+    if (latest && latest != shown->tick)
+      apply_view(&ring[latest % VIEW_RING], shown);
+    else if (__atomic_load_n(&b->done, __ATOMIC_ACQUIRE))
+      break;
+    else
+      SDL_Delay(TICK_MS / 4);
+
+    if (shown->tick)
+      draw_view(shown);
+  }
+
+  printf("viewer: %lu frames, fell behind %lu times\n", latest, lost);
+
+  munmap(p, sizeof(struct broadcast));
+  free(ring);
+  free(shown);
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * broadcast.h -- spectators of the game on screen
+ * header for broadcast.c
+ */
+
+#ifndef _broadcast_h
+#define _broadcast_h
+
+#include "proto.h"
+
+/* Frames kept in shared memory, more than there are between keyframes */
+#define BROADCAST_SLOTS 64
+
+/* Ticks from one keyframe to the next */
+#define KEYFRAME_INTERVAL 60
+
+#define BROADCAST_MAGIC 0x45444f42
+
+struct broadcast_slot
+{
+  /* Odd while the frame is written */
+  uint32 seq;
+
+  uint32 tick;
+  int len;
+  unsigned char data[MAX_FRAME_LEN];
+};
+
+/*
+ * The shared memory a game broadcasts to.
+ */
+
+struct broadcast
+{
+  uint32 magic;
+
+  /* The newest frame, the newest keyframe, and set once the game ends */
+  uint32 head, keyframe;
+  int done;
+
+  struct broadcast_slot slot[BROADCAST_SLOTS];
+};
+
+extern BOOL open_broadcast(const char *name);
+extern void broadcast_view(void);
+extern void close_broadcast(void);
+extern int run_viewer(const char *name);
+
+#endif
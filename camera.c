@@ -0,0 +1,132 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * camera.c -- scrolling view onto a tiled map
+ *
+ * The view follows a focus point.  It only scrolls once the focus leaves a
+ * dead zone around the view centre, and then moves a fraction of the way
+ * each frame.  Tile and actor drawing, and the monster turn, all use the
+ * same visible rectangle computed here.
+ */
+
+#include "camera.h"
+
+/* Division rounding towards minus infinity, for positions left of 0 */
+static int floor_div(int a, int b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* Keep the view on the map, or centre it when the map is smaller */
+static void clamp_camera(struct camera *c)
+{
+  if (c->map_w <= c->w)
+    c->x = (c->map_w - c->w) / 2;
+  else if (c->x < 0)
+    c->x = 0;
+  else if (c->x > c->map_w - c->w)
+    c->x = c->map_w - c->w;
+
+  if (c->map_h <= c->h)
+    c->y = (c->map_h - c->h) / 2;
+  else if (c->y < 0)
+    c->y = 0;
+  else if (c->y > c->map_h - c->h)
+    c->y = c->map_h - c->h;
+}
+
+void init_camera(struct camera *c, int w, int h, int tw, int th,
+                 int map_w, int map_h, int dead_w, int dead_h, int smooth)
+{
+  c->x = c->y = 0;
+  c->w = w;
+  c->h = h;
+  c->tw = tw;
+  c->th = th;
+  c->map_w = map_w;
+  c->map_h = map_h;
+  c->dead_w = dead_w;
+  c->dead_h = dead_h;
+  c->smooth = smooth > 1 ? smooth : 1;
+
+  clamp_camera(c);
+}
+
+void center_camera(struct camera *c, int fx, int fy)
+{
+  c->x = fx - c->w / 2;
+  c->y = fy - c->h / 2;
+
+  clamp_camera(c);
+}
+
+/* Distance to scroll this frame towards a target, at least one pixel */
+static int step(int from, int to, int smooth)
+{
+  int d = (to - from) / smooth;
+
+  if (d == 0 && to != from)
+    d = to > from ? 1 : -1;
+
+  return d;
+}
+
+void follow_camera(struct camera *c, int fx, int fy)
+{
+  int tx = c->x, ty = c->y;
+
+  /* Only scroll far enough to bring the focus back into the dead zone */
+  if (fx < c->x + c->w / 2 - c->dead_w)
+    tx = fx + c->dead_w - c->w / 2;
+  else if (fx > c->x + c->w / 2 + c->dead_w)
+    tx = fx - c->dead_w - c->w / 2;
+
+  if (fy < c->y + c->h / 2 - c->dead_h)
+    ty = fy + c->dead_h - c->h / 2;
+  else if (fy > c->y + c->h / 2 + c->dead_h)
+    ty = fy - c->dead_h - c->h / 2;
+
+  c->x += step(c->x, tx, c->smooth);
+  c->y += step(c->y, ty, c->smooth);
+
+  clamp_camera(c);
+}
+
+void visible_tiles(const struct camera *c, int margin, struct tile_rect *r)
+{
+  int mw = c->map_w / c->tw, mh = c->map_h / c->th;
+
+  /* Every tile with at least one pixel in the view, plus a margin */
+  r->x0 = floor_div(c->x, c->tw) - margin;
+  r->y0 = floor_div(c->y, c->th) - margin;
+  r->x1 = floor_div(c->x + c->w - 1, c->tw) + 1 + margin;
+  r->y1 = floor_div(c->y + c->h - 1, c->th) + 1 + margin;
+
+  if (r->x0 < 0) r->x0 = 0;
+  if (r->y0 < 0) r->y0 = 0;
+  if (r->x1 > mw) r->x1 = mw;
+  if (r->y1 > mh) r->y1 = mh;
+}
+
+int camera_sees(const struct camera *c, int x, int y, int w, int h)
+{
+  return x < c->x + c->w && x + w > c->x && y < c->y + c->h && y + h > c->y;
+}
@@ -0,0 +1,61 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * camera.h -- scrolling view onto a tiled map
+ * header for camera.c
+ */
+
+#ifndef _camera_h
+#define _camera_h
+
+struct camera
+{
+  /* Top left corner of the view in map pixels, and its size */
+  int x, y;
+  int w, h;
+
+  /* Map size in pixels and tile size, tiles may be any size */
+  int map_w, map_h;
+  int tw, th;
+
+  /* Half size of the box around the view centre the focus moves freely in */
+  int dead_w, dead_h;
+
+  /* Fraction of the remaining distance scrolled per frame, as a divisor */
+  int smooth;
+};
+
+/* Tiles intersecting a rectangle, x1 and y1 are exclusive */
+struct tile_rect
+{
+  int x0, y0, x1, y1;
+};
+
+extern void init_camera(struct camera *c, int w, int h, int tw, int th,
+                        int map_w, int map_h, int dead_w, int dead_h,
+                        int smooth);
+extern void center_camera(struct camera *c, int fx, int fy);
+extern void follow_camera(struct camera *c, int fx, int fy);
+extern void visible_tiles(const struct camera *c, int margin,
+                          struct tile_rect *r);
+extern int camera_sees(const struct camera *c, int x, int y, int w, int h);
+
+#endif
@@ -0,0 +1,338 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * chunk.c -- chunked store for very large maps
+ *
+ * The map is cut into square chunks that are generated when first needed.
+ * A bounded number of chunks stay resident; when a new one is needed the
+ * least recently used chunk is dropped.  Chunks that changed are written
+ * to a temporary spill file and read back from there, the others are
+ * simply generated again, so the generator must be deterministic.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "chunk.h"
+
+#define SPILL_RECORD	(2 * CHUNK_CELLS + sizeof(uint32_t) * CHUNK_SIZE)
+
+static int hash_chunk(const struct chunk_store *s, int cx, int cy)
+{
+  return ((unsigned) cx * 73856093u ^ (unsigned) cy * 19349663u) & s->hash_mask;
+}
+
+struct chunk_store *new_chunk_store(int w, int h, int max_resident,
+                                    unsigned char outside,
+                                    chunk_gen gen, void *ctx)
+{
+  struct chunk_store *s;
+  int size;
+
+  s = calloc(1, sizeof(struct chunk_store));
+  if (s == NULL)
+    return NULL;
+
+  s->w = w;
+  s->h = h;
+  s->cw = (w + CHUNK_MASK) >> CHUNK_SHIFT;
+  s->ch = (h + CHUNK_MASK) >> CHUNK_SHIFT;
+  s->outside = outside;
+  s->gen = gen;
+  s->ctx = ctx;
+  s->max_resident = max_resident > 0 ? max_resident : 1;
+
+  /* At most half full */
+  for (size = 16; size < s->max_resident * 2; size <<= 1)
+    ;
+  s->hash_mask = size - 1;
+  s->hash = calloc(size, sizeof(struct chunk *));
+  s->spilled = calloc(s->cw * s->ch, 1);
+  if (s->hash == NULL || s->spilled == NULL) {
+    free_chunk_store(s);
+    return NULL;
+  }
+
+  return s;
+}
+
+void free_chunk_store(struct chunk_store *s)
+{
+  struct chunk *c, *next;
+
+  for (c = s->head; c != NULL; c = next) {
+    next = c->next;
+    free(c);
+  }
+
+  if (s->spill != NULL)
+    fclose(s->spill);
+  free(s->hash);
+  free(s->spilled);
+  free(s);
+}
+
+static void unlink_chunk(struct chunk_store *s, struct chunk *c)
+{
+  if (c->prev) c->prev->next = c->next; else s->head = c->next;
+  if (c->next) c->next->prev = c->prev; else s->tail = c->prev;
+}
+
+static void push_chunk(struct chunk_store *s, struct chunk *c)
+{
+  c->prev = NULL;
+  c->next = s->head;
+  if (s->head) s->head->prev = c; else s->tail = c;
+  s->head = c;
+}
+
+static int seek_spill(struct chunk_store *s, int cx, int cy)
+{
+  off_t pos = (off_t) (cy * s->cw + cx) * SPILL_RECORD;
+
+  return fseeko(s->spill, pos, SEEK_SET) == 0;
+}
+
+/* Write a changed chunk to the spill file, returns 0 if it must stay */
+static int spill_chunk(struct chunk_store *s, struct chunk *c)
+{
+  if (s->spill == NULL) {
+    s->spill = tmpfile();
+    if (s->spill == NULL) {
+      perror("Unable to create chunk spill file");
+      return 0;
+    }
+  }
+
+  if (!seek_spill(s, c->cx, c->cy) ||
+      fwrite(c->cells, CHUNK_CELLS, 1, s->spill) != 1 ||
+      fwrite(c->gfx, CHUNK_CELLS, 1, s->spill) != 1 ||
+      fwrite(c->known, sizeof(c->known), 1, s->spill) != 1) {
+    perror("Unable to spill chunk");
+    return 0;
+  }
+
+  s->spilled[c->cy * s->cw + c->cx] = 1;
+  s->spills++;
+
+  return 1;
+}
+
+static int reload_chunk(struct chunk_store *s, struct chunk *c)
+{
+  if (fflush(s->spill) != 0 || !seek_spill(s, c->cx, c->cy) ||
+      fread(c->cells, CHUNK_CELLS, 1, s->spill) != 1 ||
+      fread(c->gfx, CHUNK_CELLS, 1, s->spill) != 1 ||
+      fread(c->known, sizeof(c->known), 1, s->spill) != 1) {
+    perror("Unable to read spilled chunk");
+    return 0;
+  }
+
+  s->reloads++;
+
+  return 1;
+}
+
+/* Drop the least recently used chunk and return it for reuse */
+static struct chunk *evict_chunk(struct chunk_store *s)
+{
+  struct chunk *c, **p;
+
+  /* Changed chunks that cannot be written stay, beyond the limit */
+  for (c = s->tail; c != NULL; c = c->prev)
+    if (!c->dirty || spill_chunk(s, c))
+      break;
+  if (c == NULL)
+    return NULL;
+
+  unlink_chunk(s, c);
+  for (p = &s->hash[hash_chunk(s, c->cx, c->cy)]; *p != c; p = &(*p)->hnext)
+    ;
+  *p = c->hnext;
+
+  if (s->last == c)
+    s->last = NULL;
+  s->resident--;
+
+  return c;
+}
+
+/*
+ * Chunk cx,cy, which must lie on the map.  It becomes the most recently
+ * used chunk and stays valid until another chunk is looked up.
+ */
+
+struct chunk *get_chunk(struct chunk_store *s, int cx, int cy)
+{
+  struct chunk *c;
+  int h;
+
+  if (s->last != NULL && s->last->cx == cx && s->last->cy == cy)
+    return s->last;
+
+  h = hash_chunk(s, cx, cy);
+  for (c = s->hash[h]; c != NULL; c = c->hnext)
+    if (c->cx == cx && c->cy == cy)
+      break;
+
+  if (c != NULL) {
+    unlink_chunk(s, c);
+    push_chunk(s, c);
+    s->last = c;
+    return c;
+  }
+
+  s->misses++;
+
+  c = NULL;
+  if (s->resident >= s->max_resident)
+    c = evict_chunk(s);
+  if (c == NULL)
+    c = malloc(sizeof(struct chunk));
+  if (c == NULL) {
+    fprintf(stderr, "Fatal Error -- Out of memory for map chunks\n");
+    exit(1);
+  }
+
+  c->cx = cx;
+  c->cy = cy;
+  c->dirty = 0;
+
+  if (!s->spilled[cy * s->cw + cx] || !reload_chunk(s, c)) {
+    memset(c->gfx, 0, sizeof(c->gfx));
+    memset(c->known, 0, sizeof(c->known));
+    s->gen(s->ctx, cx, cy, c->cells, c->gfx);
+    s->generated++;
+  }
+
+  c->hnext = s->hash[h];
+  s->hash[h] = c;
+  push_chunk(s, c);
+  s->resident++;
+  s->last = c;
+
+  return c;
+}
+
+static struct chunk *chunk_at(struct chunk_store *s, int x, int y)
+{
+  s->lookups++;
+  return get_chunk(s, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+}
+
+#define ON_MAP(s, x, y) \
+  ((unsigned) (x) < (unsigned) (s)->w && (unsigned) (y) < (unsigned) (s)->h)
+
+#define CELL(x, y) ((((y) & CHUNK_MASK) << CHUNK_SHIFT) + ((x) & CHUNK_MASK))
+
+unsigned char chunk_cell(struct chunk_store *s, int x, int y)
+{
+  if (!ON_MAP(s, x, y))
+    return s->outside;
+
+  return chunk_at(s, x, y)->cells[CELL(x, y)];
+}
+
+void set_chunk_cell(struct chunk_store *s, int x, int y, unsigned char v)
+{
+  struct chunk *c;
+
+  if (!ON_MAP(s, x, y))
+    return;
+
+  c = chunk_at(s, x, y);
+  if (c->cells[CELL(x, y)] != v) {
+    c->cells[CELL(x, y)] = v;
+    c->dirty = 1;
+  }
+}
+
+unsigned char chunk_gfx(struct chunk_store *s, int x, int y)
+{
+  if (!ON_MAP(s, x, y))
+    return 0;
+
+  return chunk_at(s, x, y)->gfx[CELL(x, y)];
+}
+
+void set_chunk_gfx(struct chunk_store *s, int x, int y, unsigned char g)
+{
+  struct chunk *c;
+
+  if (!ON_MAP(s, x, y))
+    return;
+
+  c = chunk_at(s, x, y);
+  if (c->gfx[CELL(x, y)] != g) {
+    c->gfx[CELL(x, y)] = g;
+    c->dirty = 1;
+  }
+}
+
+int chunk_known(struct chunk_store *s, int x, int y)
+{
+  if (!ON_MAP(s, x, y))
+    return 0;
+
+  return (chunk_at(s, x, y)->known[y & CHUNK_MASK] >> (x & CHUNK_MASK)) & 1;
+}
+
+void set_chunk_known(struct chunk_store *s, int x, int y, int known)
+{
+  struct chunk *c;
+  uint32_t bit, *row;
+
+  if (!ON_MAP(s, x, y))
+    return;
+
+  c = chunk_at(s, x, y);
+  row = &c->known[y & CHUNK_MASK];
+  bit = (uint32_t) 1 << (x & CHUNK_MASK);
+
+  if (((*row & bit) != 0) != (known != 0)) {
+    *row ^= bit;
+    c->dirty = 1;
+  }
+}
+
+/*
+ * The known bits of cells x1 to x2 of row y, with x1 as bit 0.  The cells
+ * must lie on the map and in one chunk.  If 'set' they all become known.
+ */
+
+uint32_t chunk_known_span(struct chunk_store *s, int x1, int x2, int y, int set)
+{
+  struct chunk *c;
+  uint32_t mask, *row, bits;
+
+  c = chunk_at(s, x1, y);
+  row = &c->known[y & CHUNK_MASK];
+  mask = (~(uint32_t) 0 >> (CHUNK_MASK - (x2 - x1))) << (x1 & CHUNK_MASK);
+  bits = *row & mask;
+
+  if (set && bits != mask) {
+    *row |= mask;
+    c->dirty = 1;
+  }
+
+  return bits >> (x1 & CHUNK_MASK);
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * chunk.h -- chunked store for very large maps
+ * header for chunk.c
+ */
+
+#ifndef _chunk_h
+#define _chunk_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Chunks are square, a power of two cells on a side */
+#define CHUNK_SHIFT	5
+#define CHUNK_SIZE	(1 << CHUNK_SHIFT)
+#define CHUNK_MASK	(CHUNK_SIZE - 1)
+#define CHUNK_CELLS	(CHUNK_SIZE * CHUNK_SIZE)
+
+/* Fills the cells of chunk cx,cy and their graphics, row by row */
+typedef void (*chunk_gen)(void *ctx, int cx, int cy, unsigned char *cells,
+                          unsigned char *gfx);
+
+struct chunk
+{
+  int cx, cy;
+
+  /* Changed since it was generated or read back */
+  int dirty;
+
+  /* Least recently used order and hash chain */
+  struct chunk *prev, *next;
+  struct chunk *hnext;
+
+  unsigned char cells[CHUNK_CELLS];
+
+  /* What each cell is drawn as, zero unless the generator says */
+  unsigned char gfx[CHUNK_CELLS];
+
+  /* One bit per cell of a row, set for known cells */
+  uint32_t known[CHUNK_SIZE];
+};
+
+struct chunk_store
+{
+  /* Size in cells and in chunks */
+  int w, h;
+  int cw, ch;
+
+  /* Cell value outside the map */
+  unsigned char outside;
+
+  chunk_gen gen;
+  void *ctx;
+
+  /* Resident chunks, most recently used first */
+  int resident, max_resident;
+  struct chunk *head, *tail;
+  struct chunk **hash;
+  int hash_mask;
+
+  /* The chunk of the last lookup, most lookups hit it again */
+  struct chunk *last;
+
+  /* Cold chunks that changed are written here, one flag per chunk */
+  FILE *spill;
+  unsigned char *spilled;
+
+  /* Statistics */
+  unsigned long lookups, misses, generated, spills, reloads;
+};
+
+extern struct chunk_store *new_chunk_store(int w, int h, int max_resident,
+                                           unsigned char outside,
+                                           chunk_gen gen, void *ctx);
+extern void free_chunk_store(struct chunk_store *s);
+extern struct chunk *get_chunk(struct chunk_store *s, int cx, int cy);
+extern unsigned char chunk_cell(struct chunk_store *s, int x, int y);
+extern void set_chunk_cell(struct chunk_store *s, int x, int y,
+                           unsigned char c);
+extern unsigned char chunk_gfx(struct chunk_store *s, int x, int y);
+extern void set_chunk_gfx(struct chunk_store *s, int x, int y,
+                          unsigned char g);
+extern int chunk_known(struct chunk_store *s, int x, int y);
+extern void set_chunk_known(struct chunk_store *s, int x, int y, int known);
+extern uint32_t chunk_known_span(struct chunk_store *s, int x1, int x2, int y,
+                                 int set);
+
+#endif
@@ -64,12 +64,19 @@
  * right now -- this should nonetheless be sufficient.
  */
 
-/* Screen width. */
+/* Default screen width, the game is drawn at this size and scaled up. */
 #define SCREEN_W 640
 
-/* Screen height. */
+/* Default screen height. */
 #define SCREEN_H 480
 
+/* Smallest screen the panels fit on. */
+#define MIN_SCREEN_W 320
+#define MIN_SCREEN_H 240
+
+/* Largest integer scale factor for the window. */
+#define MAX_SCALE 4
+
 /* Font size */
 #define FNT_H 8
 #define FNT_W 8
@@ -77,6 +84,12 @@
 /* Message bar height */
 #define MSG_H 24
 
+/* Number of messages kept in the message log. */
+#define MESSAGE_LOG_SIZE 64
+
+/* Milliseconds a message stays on the message bar. */
+#define MESSAGE_TIMEOUT 4000
+
 /* Status bar height */
 #define STATUS_H 24
 
@@ -101,6 +114,13 @@
 /* Map height (must be divisable by NSECT_H). */
 #define MAP_H (SECT_H * NSECT_H)
 
+/*
+ * Map chunks of each level kept in memory.  A level of this size has 8
+ * chunks and client views read all of it every tick, so the game keeps
+ * whole levels and never evicts; 'edomgen stream' exercises eviction.
+ */
+#define LEVEL_CHUNKS 8
+
 /* Visible map width. */
 #define VMAP_W 80
 
@@ -113,9 +133,6 @@
 /* Maximum height for a room. */
 #define ROOM_H (SECT_H - 2)
 
-/* Bitmap width for the knowledge map. */
-#define MAP_BIT_W ((MAP_W >> 3) + 1)
-
 /* Maximum number of monsters per level. */
 #define MONSTERS_PER_LEVEL 64
 
@@ -143,8 +160,21 @@
 /* The number of training units you can distribute. */
 #define TUNITS 100
 
-/* Size of graphical tiles */
+/* Size of graphical tiles, they need not be powers of two */
 #define TILE_WIDTH   32
 #define TILE_HEIGHT  32
 
+/* Half size of the box the player moves in before the view scrolls */
+#define CAMERA_DEADZONE_W 48
+#define CAMERA_DEADZONE_H 32
+
+/* The view scrolls this fraction of the remaining distance per frame */
+#define CAMERA_SMOOTH 4
+
+/* Length of a game tick in milliseconds, the game runs at a fixed rate */
+#define TICK_MS 16
+
+/* Ticks a stalled game catches up on before it skips ahead */
+#define MAX_CATCH_UP 8
+
 #endif
@@ -18,121 +18,249 @@
 *   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+/*
+ * ctrl.c -- keys and input events
+ *
+ * Keys are looked up in a binding table that a file may change.  The
+ * event pump turns key presses into action events stamped with the time
+ * they arrived and puts them on a queue.  The game takes them off at
+ * fixed ticks: an event is seen by the first tick at or after its time,
+ * however often frames are drawn.  The queue has one producer and one
+ * consumer and needs no lock, so the pump could run on a thread of its
+ * own.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
 
 #include "ctrl.h"
 
-int get_input(void)
+/* The actions of every key */
+static int keymap[SDLK_LAST] =
 {
-  int input = 0;
-  Uint8 *keys = SDL_GetKeyState(NULL);
+  [SDLK_ESCAPE]   = PRESS_ESC,
+  [SDLK_UP]       = PRESS_UP,
+  [SDLK_RIGHT]    = PRESS_RIGHT,
+  [SDLK_LEFT]     = PRESS_LEFT,
+  [SDLK_DOWN]     = PRESS_DOWN,
+  [SDLK_RETURN]   = PRESS_ENTER,
+  [SDLK_SPACE]    = PRESS_FIRE,
+  [SDLK_PAGEUP]   = PRESS_ADVANCE,
+  [SDLK_PAGEDOWN] = PRESS_REVERT,
+  [SDLK_m]        = PRESS_LOG,
+  [SDLK_d]        = PRESS_DIG
+};
 
-  if(keys[SDLK_ESCAPE])
-    input=SET_BITS(input,PRESS_ESC);
+/* Action names in binding files */
+static const struct
+{
+  const char *name;
+  int action;
+} actions[] =
+{
+  { "right", PRESS_RIGHT },
+  { "left", PRESS_LEFT },
+  { "up", PRESS_UP },
+  { "down", PRESS_DOWN },
+  { "open", PRESS_ENTER },
+  { "attack", PRESS_FIRE },
+  { "descend", PRESS_ADVANCE },
+  { "ascend", PRESS_REVERT },
+  { "quit", PRESS_ESC },
+  { "log", PRESS_LOG },
+  { "dig", PRESS_DIG },
+  { "none", 0 }
+};
 
-  if(keys[SDLK_UP])
-    input=SET_BITS(input,PRESS_UP);
+/* Written by the pump at 'head', read by the game at 'tail' */
+static struct input_event queue[INPUT_QUEUE_SIZE];
+static unsigned int queue_head, queue_tail;
 
-  if(keys[SDLK_RIGHT])
-    input=SET_BITS(input,PRESS_RIGHT);
+/* Actions held down as of the last event taken */
+static int held_actions;
 
-  if(keys[SDLK_LEFT])
-    input=SET_BITS(input,PRESS_LEFT);
+int key_action(int ks)
+{
+  if (ks < 0 || ks >= SDLK_LAST)
+    return 0;
 
-  if(keys[SDLK_DOWN])
-    input=SET_BITS(input,PRESS_DOWN);
+  return keymap[ks];
+}
 
-  if(keys[SDLK_RETURN])
-    input=SET_BITS(input,PRESS_ENTER);
+void bind_key(int ks, int action)
+{
+  if (ks >= 0 && ks < SDLK_LAST)
+    keymap[ks] = action;
+}
 
-  if(keys[SDLK_SPACE])
-    input=SET_BITS(input,PRESS_FIRE);
+static int find_key(const char *name)
+{
+  int ks;
 
-  if(keys[SDLK_PAGEUP])
-    input=SET_BITS(input,PRESS_ADVANCE);
+  for (ks = SDLK_FIRST; ks < SDLK_LAST; ks++)
+    if (strcasecmp(SDL_GetKeyName(ks), name) == 0)
+      return ks;
 
-  if(keys[SDLK_PAGEDOWN])
-    input=SET_BITS(input,PRESS_REVERT);
+  return -1;
+}
+
+static int find_action(const char *name)
+{
+  int i;
 
-  return input;
+  for (i = 0; i < (int) (sizeof(actions) / sizeof(actions[0])); i++)
+    if (strcasecmp(actions[i].name, name) == 0)
+      return i;
+
+  return -1;
 }
 
-int get_input_keydown(int ks)
+/* Cut off trailing white space */
+static void trim(char *s)
 {
-  int input = 0;
-
-   switch(ks)
-   {
-      case SDLK_ESCAPE:
-	 input=SET_BITS(input,PRESS_ESC);
-	 break;
-      case SDLK_UP:
-         input=SET_BITS(input,PRESS_UP);
-         break;
-      case SDLK_RIGHT:
-         input=SET_BITS(input,PRESS_RIGHT);
-         break;
-      case SDLK_LEFT:
-         input=SET_BITS(input,PRESS_LEFT);
-         break;
-      case SDLK_DOWN:
-         input=SET_BITS(input,PRESS_DOWN);
-         break;
-      case SDLK_RETURN:
-         input=SET_BITS(input,PRESS_ENTER);
-         break;
-      case SDLK_SPACE:
-         input=SET_BITS(input,PRESS_FIRE);
-         break;
-      case SDLK_PAGEUP:
-         input=SET_BITS(input,PRESS_ADVANCE);
-         break;
-      case SDLK_PAGEDOWN:
-         input=SET_BITS(input,PRESS_REVERT);
-         break;
-      default: break;
-   }
-
-   return input;
+  char *p = s + strlen(s);
+
+  while (p > s && isspace((unsigned char) p[-1]))
+    p--;
+  *p = '\0';
 }
 
-int get_input_keyup(int ks)
+/*
+ * Bind keys from the file 'fn'.  Every line holds an SDL key name and an
+ * action, "page up descend" or "w up"; "none" unbinds a key.  Lines
+ * starting with '#' are comments.
+ */
+
+BOOL load_bindings(const char *fn)
 {
-  int input = 0;
-
-   switch(ks)
-   {
-      case SDLK_ESCAPE:
-	 input=RESET_BITS(input,PRESS_ESC);
-	 break;
-      case SDLK_UP:
-         input=RESET_BITS(input,PRESS_UP);
-         break;
-      case SDLK_RIGHT:
-         input=RESET_BITS(input,PRESS_RIGHT);
-         break;
-      case SDLK_LEFT:
-         input=RESET_BITS(input,PRESS_LEFT);
-         break;
-      case SDLK_DOWN:
-         input=RESET_BITS(input,PRESS_DOWN);
-         break;
-      case SDLK_RETURN:
-         input=RESET_BITS(input,PRESS_ENTER);
-         break;
-      case SDLK_SPACE:
-         input=RESET_BITS(input,PRESS_FIRE);
-         break;
-      case SDLK_PAGEUP:
-         input=RESET_BITS(input,PRESS_ADVANCE);
-         break;
-      case SDLK_PAGEDOWN:
-         input=RESET_BITS(input,PRESS_REVERT);
-         break;
-      default: break;
-   }
-
-   return input;
+  char line[128], *p, *action;
+  int n = 0, ks, i;
+  FILE *f;
+
+  f = fopen(fn, "r");
+  if (f == NULL) {
+    perror(fn);
+    return FALSE;
+  }
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+
+    n++;
+    trim(line);
+    for (p = line; isspace((unsigned char) *p); p++);
+    if (*p == '\0' || *p == '#')
+      continue;
+
+    /* The action is the last word, key names may have spaces */
+    action = strrchr(p, ' ');
+    if (action == NULL) {
+      fprintf(stderr, "%s:%d: key and action expected\n", fn, n);
+      fclose(f);
+      return FALSE;
+    }
+    *action++ = '\0';
+    trim(p);
+
+    ks = find_key(p);
+    i = find_action(action);
+    if (ks < 0 || i < 0) {
+      fprintf(stderr, "%s:%d: unknown %s '%s'\n", fn, n,
+              ks < 0 ? "key" : "action", ks < 0 ? p : action);
+      fclose(f);
+      return FALSE;
+    }
+
+    bind_key(ks, actions[i].action);
+  }
+
+  fclose(f);
+  return TRUE;
 }
 
+/*
+ * Queue an event, FALSE if the queue is full and the event is dropped.
+ * Only one thread may push.
+ */
+
+BOOL push_input(Uint32 time, int action, BOOL down)
+{
+  unsigned int head = queue_head;
+  struct input_event *e;
+
+  if (head - __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE) ==
+      INPUT_QUEUE_SIZE)
+    return FALSE;
+
+  e = &queue[head % INPUT_QUEUE_SIZE];
+  e->time = time;
+  e->action = action;
+  e->down = down;
+
+  __atomic_store_n(&queue_head, head + 1, __ATOMIC_RELEASE);
+  return TRUE;
+}
+
+/*
+ * Queue the bound keys going down and up since the last call.  Closing
+ * the window is quitting.
+ */
+
+void pump_input(void)
+{
+  SDL_Event event;
+  Uint32 now = SDL_GetTicks();
+  int action;
+
+  while (SDL_PollEvent(&event))
+  {
+    switch (event.type)
+    {
+      case SDL_QUIT:
+        push_input(now, PRESS_ESC, TRUE);
+        break;
+
+      case SDL_KEYDOWN:
+      case SDL_KEYUP:
+        action = key_action(event.key.keysym.sym);
+        if (action)
+          push_input(now, action, event.type == SDL_KEYDOWN);
+        break;
+    }
+  }
+}
+
+/*
+ * Take the events up to the time 'until'.  'held' are the actions held
+ * down and 'pressed' those that went down.  A key pressed and released
+ * again counts as held once, so short taps are not lost.  Only one
+ * thread may take.
+ */
+
+void take_input(Uint32 until, int *held, int *pressed)
+{
+  unsigned int tail = queue_tail;
+  struct input_event *e;
+
+  *pressed = 0;
+  while (tail != __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE))
+  {
+    e = &queue[tail % INPUT_QUEUE_SIZE];
+    if ((Sint32) (e->time - until) > 0)
+      break;
+
+    if (e->down)
+    {
+      held_actions |= e->action;
+      *pressed |= e->action;
+    }
+    else
+      held_actions &= ~e->action;
+
+    __atomic_store_n(&queue_tail, ++tail, __ATOMIC_RELEASE);
+  }
+
+  *held = held_actions | *pressed;
+}
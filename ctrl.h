@@ -22,6 +22,7 @@
 #define _ctrl_h
 
 #include "SDL.h"
+#include "sysdep.h"
 
 #define PRESS_RIGHT 1
 #define PRESS_LEFT 2
@@ -32,15 +33,28 @@
 #define PRESS_ADVANCE 64
 #define PRESS_REVERT 128
 #define PRESS_ESC 256
+#define PRESS_LOG 512
+#define PRESS_DIG 1024
 
-#define SET_BITS(x,bits) (x|bits)
-#define RESET_BITS(x,bits) (x&~bits)
+/* Input events waiting for the game, a power of two */
+#define INPUT_QUEUE_SIZE 256
 
-extern int input;
+struct input_event
+{
+  /* When the event arrived, in SDL ticks */
+  Uint32 time;
 
-extern int get_input(void);
-extern int get_input_keydown(int ks);
-extern int get_input_keyup(int ks);
+  /* The actions of the key and whether it went down */
+  int action;
+  BOOL down;
+};
 
-#endif
+extern int key_action(int ks);
+extern void bind_key(int ks, int action);
+extern BOOL load_bindings(const char *fn);
+
+extern BOOL push_input(Uint32 time, int action, BOOL down);
+extern void pump_input(void);
+extern void take_input(Uint32 until, int *held, int *pressed);
 
+#endif
@@ -0,0 +1,569 @@
+/*                               -*- Mode: C -*-
+ * dig.c --
+ *
+ * (C) Copyright 1996, 1997 by Thomas Biskup.
+ * All Rights Reserved.
+ *
+ * This software may be distributed only for educational, research and
+ * other non-proft purposes provided that this copyright notice is left
+ * intact.  If you derive a new game from these sources you also are
+ * required to give credit to Thomas Biskup for creating them in the first
+ * place.  These sources must not be distributed for any fees in excess of
+ * $3 (as of January, 1997).
+ */
+
+/*
+ * The level generator.  Everything in here works on an explicit level
+ * description and map so that levels can be generated in parallel by the
+ * offline tools.  The random number generator keeps its state per thread.
+ */
+
+#include <string.h>
+
+#include "dig.h"
+
+
+/*
+ * Local prototypes.
+ */
+
+static void dig_section(struct level *, coord, coord, byte *);
+static void dig_stairs(struct level *, byte);
+static void connect_sections(const struct level *, coord, coord, coord, coord,
+			     byte, byte [MAP_W][MAP_H]);
+static void get_random_section(const struct level *, coord *, coord *);
+static int section_width(const struct section *);
+static int section_height(const struct section *);
+
+
+
+/*
+ * Determine the random seed for a given level of a dungeon.
+ */
+
+rand_type level_seed(rand_type seed, byte depth)
+{
+  return seed + (rand_type) depth * 0x9e3779b9U;
+}
+
+
+
+/*
+ * Create one single dungeon level.
+ */
+
+void dig_level(struct level *lv, byte depth)
+{
+  coord w, h, sectx[SECT_NUMBER], secty[SECT_NUMBER];
+  int16 i, index[SECT_NUMBER];
+  byte existence_chance;
+
+  /*
+   * Determine a random order for the section generation.
+   */
+
+  /* Initial order. */
+  i = 0;
+  for (w = 0; w < NSECT_W; w++)
+    for (h = 0; h < NSECT_H; h++)
+    {
+      index[i] = i;
+      sectx[i] = w;
+      secty[i] = h;
+      i++;
+    }
+
+  /* Randomly shuffle the initial order. */
+  for (i = 0; i < SECT_NUMBER; i++)
+  {
+    int16 j, k, dummy;
+
+    j = rand_int(SECT_NUMBER);
+    k = rand_int(SECT_NUMBER);
+
+    dummy = index[j];
+    index[j] = index[k];
+    index[k] = dummy;
+  }
+
+  /*
+   * Create each section separately.
+   */
+
+  /* Initially there is a 30% chance for rooms to be non-existant. */
+  existence_chance = 70;
+
+  /* Dig each section. */
+  for (i = 0; i < SECT_NUMBER; i++)
+    dig_section(lv, sectx[index[i]], secty[index[i]], &existence_chance);
+
+  /* Build some stairs. */
+  dig_stairs(lv, depth);
+}
+
+
+
+/*
+ * Dig one section for the dungeon.
+ *
+ * The game assumes that one section is SECT_W * SECT_H tiles in size.
+ * A section can contain a room with up to four doors or simply be an
+ * intersction of several passages.
+ *
+ */
+
+static void dig_section(struct level *lv, coord x, coord y,
+			byte *existence_chance)
+{
+  struct section *s = &lv->s[x][y];
+
+  if (rand_byte(100) + 1 >= *existence_chance)
+  {
+    /* No room here. */
+    s->exists = FALSE;
+
+    /* Decrease the chance for further empty rooms. */
+    *existence_chance += 3;
+  }
+  else
+  {
+    byte dir;
+
+    /* Yeah :-) ! */
+    s->exists = TRUE;
+
+    /*
+     * Dig a room.
+     *
+     * Rooms are at least 4x4 tiles in size.
+     */
+
+    do
+    {
+      s->rx1 = x * SECT_W + rand_byte(3) + 1;
+      s->ry1 = y * SECT_H + rand_byte(3) + 1;
+      s->rx2 = (x + 1) * SECT_W - rand_byte(3) - 2;
+      s->ry2 = (y + 1) * SECT_H - rand_byte(3) - 2;
+    }
+    while (s->rx2 - s->rx1 < 3 || s->ry2 - s->ry1 < 3);
+
+    /*
+     * Create doors.
+     *
+     * XXX: At some point it would be nice to create doors only for
+     *      some directions to make the dungeon less regular.
+     */
+
+    for (dir = N; dir <= E; dir++)
+      if (dir_possible(x, y, dir))
+      {
+	switch (dir)
+	{
+	  case N:
+	    s->dx[dir] = s->rx1 + rand_byte(section_width(s) - 1) + 1;
+	    s->dy[dir] = s->ry1;
+	    break;
+
+	  case S:
+	    s->dx[dir] = s->rx1 + rand_byte(section_width(s) - 1) + 1;
+	    s->dy[dir] = s->ry2;
+	    break;
+
+	  case E:
+	    s->dy[dir] = s->ry1 + rand_byte(section_height(s) - 1) + 1;
+	    s->dx[dir] = s->rx2;
+	    break;
+
+	  case W:
+	    s->dy[dir] = s->ry1 + rand_byte(section_height(s) - 1) + 1;
+	    s->dx[dir] = s->rx1;
+	    break;
+
+	  default:
+	    break;
+	}
+	s->dt[dir] = FLOOR; /* No doors for now: rand_door();*/
+      }
+      else
+	s->dt[dir] = NO_DOOR;
+  }
+}
+
+
+
+/*
+ * Calculate the room width for a specific room section.
+ */
+
+static int section_width(const struct section *s)
+{
+  return (s->rx2 - s->rx1 - 1);
+}
+
+
+
+/*
+ * Calculate the room height for a specific room section.
+ */
+
+static int section_height(const struct section *s)
+{
+  return (s->ry2 - s->ry1 - 1);
+}
+
+
+
+/*
+ * Determine a random door type.
+ */
+
+byte rand_door(void)
+{
+  byte roll = rand_byte(100);
+
+  if (roll < 75)
+    return OPEN_DOOR;
+  else if (roll < 90)
+    return CLOSED_DOOR;
+
+  return LOCKED_DOOR;
+}
+
+
+
+/*
+ * Build the map for a level from its section descriptions.
+ */
+
+void build_level(const struct level *lv, byte depth, byte map[MAP_W][MAP_H])
+{
+  coord x, y, sx, sy;
+  byte dir;
+
+  /* Basic initialization. */
+  for (x = 0; x < MAP_W; x++)
+    for (y = 0; y < MAP_H; y++)
+      map[x][y] = ROCK;
+
+  /* Build each section. */
+  for (sx = 0; sx < NSECT_W; sx++)
+    for (sy = 0; sy < NSECT_H; sy++)
+    {
+      const struct section *s = &lv->s[sx][sy];
+
+      /* Handle each section. */
+      if (s->exists)
+      {
+	/* Paint existing room. */
+	for (x = s->rx1 + 1; x < s->rx2; x++)
+	  for (y = s->ry1 + 1; y < s->ry2; y++)
+	    map[x][y] = FLOOR;
+
+	/* Paint doors. */
+	for (dir = N; dir <= E; dir++)
+	  if (s->dt[dir] != NO_DOOR)
+	    map[s->dx[dir]][s->dy[dir]] = s->dt[dir];
+      }
+    }
+
+
+  /* Connect each section. */
+  for (sx = 0; sx < NSECT_W; sx++)
+    for (sy = 0; sy < NSECT_H; sy++)
+    {
+      if (dir_possible(sx, sy, E))
+	connect_sections(lv, sx, sy, sx + 1, sy, E, map);
+      if (dir_possible(sx, sy, S))
+	connect_sections(lv, sx, sy, sx, sy + 1, S, map);
+    }
+
+  /* Place the stairways. */
+  map[lv->stxu][lv->styu] = STAIR_UP;
+  if (depth < MAX_DUNGEON_LEVEL - 1)
+    map[lv->stxd][lv->styd] = STAIR_DOWN;
+}
+
+
+
+
+/*
+ * Connect two sections of a level.
+ */
+
+static void connect_sections(const struct level *lv,
+			     coord sx1, coord sy1, coord sx2, coord sy2,
+			     byte dir, byte map[MAP_W][MAP_H])
+{
+  const struct section *s1 = &lv->s[sx1][sy1];
+  const struct section *s2 = &lv->s[sx2][sy2];
+  coord cx1, cy1, cx2, cy2, mx, my, x, y;
+
+  /* Get the start coordinates from section #1. */
+  if (s1->exists)
+  {
+    if (dir == S)
+    {
+      cx1 = s1->dx[S];
+      cy1 = s1->dy[S];
+    }
+    else
+    {
+      cx1 = s1->dx[E];
+      cy1 = s1->dy[E];
+    }
+  }
+  else
+  {
+    cx1 = sx1 * SECT_W + (SECT_W >> 1);
+    cy1 = sy1 * SECT_H + (SECT_H >> 1);
+  }
+
+  /* Get the end coordinates from section #2. */
+  if (s2->exists)
+  {
+    if (dir == S)
+    {
+      cx2 = s2->dx[N];
+      cy2 = s2->dy[N];
+    }
+    else
+    {
+      cx2 = s2->dx[W];
+      cy2 = s2->dy[W];
+    }
+  }
+  else
+  {
+    cx2 = sx2 * SECT_W + (SECT_W >> 1);
+    cy2 = sy2 * SECT_H + (SECT_H >> 1);
+  }
+
+  /* Get the middle of the section. */
+  mx = (cx1 + cx2) >> 1;
+  my = (cy1 + cy2) >> 1;
+
+  /* Draw the tunnel. */
+  x = cx1;
+  y = cy1;
+  if (dir == E)
+  {
+    /* Part #1. */
+    while (x < mx)
+    {
+      if (map[x][y] == ROCK)
+	map[x][y] = FLOOR;
+      x++;
+    }
+
+    /* Part #2. */
+    if (y < cy2)
+      while (y < cy2)
+      {
+	if (map[x][y] == ROCK)
+	  map[x][y] = FLOOR;
+	y++;
+      }
+    else
+      while (y > cy2)
+      {
+	if (map[x][y] == ROCK)
+	  map[x][y] = FLOOR;
+	y--;
+      }
+
+    /* Part #3. */
+    while (x < cx2)
+    {
+      if (map[x][y] == ROCK)
+	map[x][y] = FLOOR;
+      x++;
+    }
+    if (map[x][y] == ROCK)
+      map[x][y] = FLOOR;
+  }
+  else
+  {
+    /* Part #1. */
+    while (y < my)
+    {
+      if (map[x][y] == ROCK)
+	map[x][y] = FLOOR;
+      y++;
+    }
+    if (map[x][y] == ROCK)
+      map[x][y] = FLOOR;
+
+    /* Part #2. */
+    if (x < cx2)
+      while (x < cx2)
+      {
+	if (map[x][y] == ROCK)
+	  map[x][y] = FLOOR;
+	x++;
+      }
+    else
+      while (x > cx2)
+      {
+	if (map[x][y] == ROCK)
+	  map[x][y] = FLOOR;
+	x--;
+      }
+
+    /* Part #3. */
+    while (y < cy2)
+    {
+      if (map[x][y] == ROCK)
+	map[x][y] = FLOOR;
+      y++;
+    }
+  }
+  if (map[x][y] == ROCK)
+    map[x][y] = FLOOR;
+}
+
+
+
+/*
+ * Determine whether a given section is set on a border.
+ */
+
+BOOL dir_possible(coord x, coord y, byte dir)
+{
+  return ((dir == N && y > 0) ||
+	  (dir == S && y < NSECT_H - 1) ||
+	  (dir == W && x > 0) ||
+	  (dir == E && x < NSECT_W - 1));
+}
+
+
+
+/*
+ * Each level requires at least one stair!
+ */
+
+static void dig_stairs(struct level *lv, byte depth)
+{
+  coord sx, sy, x, y;
+
+  /* Dig stairs upwards. */
+
+  /* Find a section. */
+  get_random_section(lv, &sx, &sy);
+
+  lv->stxu = lv->s[sx][sy].rx1 + rand_byte(section_width(&lv->s[sx][sy]) - 1) + 1;
+  lv->styu = lv->s[sx][sy].ry1 + rand_byte(section_height(&lv->s[sx][sy]) - 1) + 1;
+
+  /* Dig stairs downwards. */
+  if (depth < MAX_DUNGEON_LEVEL - 1)
+  {
+    /* Find a section. */
+    get_random_section(lv, &sx, &sy);
+
+    /* Find a good location. */
+    do
+    {
+      x = lv->s[sx][sy].rx1 + rand_byte(section_width(&lv->s[sx][sy]) - 1) + 1;
+      y = lv->s[sx][sy].ry1 + rand_byte(section_height(&lv->s[sx][sy]) - 1) + 1;
+    }
+    while (depth && x == lv->stxu && y == lv->styu);
+
+    /* Place the stairway. */
+    lv->stxd = x;
+    lv->styd = y;
+  }
+  else
+    lv->stxd = lv->styd = -1;
+}
+
+
+
+/*
+ * Find a random section on a level.
+ */
+
+static void get_random_section(const struct level *lv, coord *sx, coord *sy)
+{
+  do
+  {
+    *sx = rand_int(NSECT_W);
+    *sy = rand_int(NSECT_H);
+  }
+  while (!lv->s[*sx][*sy].exists);
+}
+
+
+
+/*
+ * Find the first delta entry at or after a position.
+ */
+
+static int find_delta(const struct level_delta *ld, uint16 pos)
+{
+  int lo = 0, hi = ld->n, mid;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (ld->e[mid].pos < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+
+
+/*
+ * Record that (x, y) now holds 'tile' instead of 'old'.  A change back to
+ * the built tile removes the entry.  Returns FALSE if the level can't
+ * hold any more changes.
+ */
+
+BOOL set_delta(struct level_delta *ld, coord x, coord y, byte tile, byte old)
+{
+  uint16 pos = x * MAP_H + y;
+  int i = find_delta(ld, pos);
+
+  if (i < ld->n && ld->e[i].pos == pos)
+  {
+    if (tile == ld->e[i].base)
+    {
+      memmove(&ld->e[i], &ld->e[i + 1], (ld->n - i - 1) * sizeof(ld->e[0]));
+      ld->n--;
+    }
+    else
+      ld->e[i].tile = tile;
+
+    return TRUE;
+  }
+
+  if (tile == old)
+    return TRUE;
+
+  if (ld->n >= MAX_LEVEL_DELTA)
+    return FALSE;
+
+  memmove(&ld->e[i + 1], &ld->e[i], (ld->n - i) * sizeof(ld->e[0]));
+  ld->e[i].pos = pos;
+  ld->e[i].tile = tile;
+  ld->e[i].base = old;
+  ld->n++;
+
+  return TRUE;
+}
+
+
+
+/*
+ * Apply the recorded changes to a freshly built map.
+ */
+
+void apply_delta(const struct level_delta *ld, byte map[MAP_W][MAP_H])
+{
+  int i;
+
+  for (i = 0; i < ld->n; i++)
+    map[ld->e[i].pos / MAP_H][ld->e[i].pos % MAP_H] = ld->e[i].tile;
+}
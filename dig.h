@@ -0,0 +1,112 @@
+/*                               -*- Mode: C -*-
+ * dig.h --
+ *
+ * (C) Copyright 1996, 1997 by Thomas Biskup.
+ * All Rights Reserved.
+ *
+ * This software may be distributed only for educational, research and
+ * other non-proft purposes provided that this copyright notice is left
+ * intact.  If you derive a new game from these sources you also are
+ * required to give credit to Thomas Biskup for creating them in the first
+ * place.  These sources must not be distributed for any fees in excess of
+ * $3 (as of January, 1997).
+ */
+
+#ifndef __DIG__
+
+#define __DIG__
+
+/*
+ * Includes.
+ *
+ * NOTE: The level generator must not depend on SDL so that it can be linked
+ *       into the offline tools.
+ */
+
+#include "dungeon.h"
+
+
+
+/*
+ * One section of a level: each dungeon map consists of NSECT_W * NSECT_H
+ * sections (see config.g).  A section either contains one room with up
+ * to four doors or a tunnel intersection.
+ *
+ * NOTE: Sections only describe the level as generated.  Digging and other
+ *       changes are kept in a per-level delta list (see 'struct
+ *       level_delta') which is applied on top of the built map.
+ */
+
+struct section
+{
+  /* Room available? */
+  BOOL exists;
+
+  /* Room coordinates. */
+  coord rx1, rx2, ry1, ry2;
+
+  /* Door positions. */
+  coord dx[4], dy[4];
+
+  /* Door types. */
+  byte dt[4];
+};
+
+
+
+/*
+ * The outline description of one level.  Everything else is derived from
+ * this by 'build_level'.
+ */
+
+struct level
+{
+  /* NSECT_W * NSECT_H sections. */
+  struct section s[NSECT_W][NSECT_H];
+
+  /* Coordinates for the stairways (no stairs down on the last level). */
+  coord stxu, styu;
+  coord stxd, styd;
+};
+
+
+
+/*
+ * Tile changes made to a level after it was built, such as tunnels and
+ * opened doors.  Entries are sorted by position so a level can hold a
+ * few hundred changes in a couple of kilobytes.
+ */
+
+#define MAX_LEVEL_DELTA 512
+
+struct delta_entry
+{
+  /* x * MAP_H + y */
+  uint16 pos;
+
+  /* The new tile and the one built by 'build_level'. */
+  byte tile, base;
+};
+
+struct level_delta
+{
+  uint16 n;
+  struct delta_entry e[MAX_LEVEL_DELTA];
+};
+
+
+
+/*
+ * Global functions.
+ */
+
+rand_type level_seed(rand_type, byte);
+
+void dig_level(struct level *, byte);
+void build_level(const struct level *, byte, byte [MAP_W][MAP_H]);
+BOOL dir_possible(coord, coord, byte);
+byte rand_door(void);
+BOOL set_delta(struct level_delta *, coord, coord, byte, byte);
+void apply_delta(const struct level_delta *, byte [MAP_W][MAP_H]);
+
+#endif
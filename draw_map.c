@@ -27,32 +27,149 @@
 
 #include "sprite.h"
 #include "map.h"
+#include "metrics.h"
 #include "draw_map.h"
 
+/* First tile at a map position and its screen offset, for any tile size */
+static int first_tile(int s, int t, int *offset)
+{
+  int u = s >= 0 ? s / t : -((-s + t - 1) / t);
+
+  *offset = s - u * t;
+  return u;
+}
+
 void draw_map(int x,int y, int w, int h, int opaque,
 	      Map *m, int sx, int sy, SPRITE *spr)
 {
-  int u,v,i,j;
-  int mw,tw,th;
+  int u,v,i,j,u0,i0,v0,j0;
+  int mw,mh,tw,th;
   int index;
-  int *dat;
   Tile *tls;
 
   /* Cache all variables */
   mw=(int)m->w;
+  mh=(int)m->h;
   tw=(int)m->tw;
   th=(int)m->th;
-  dat=m->dat;
   tls=m->tiles;
 
-  /* Do drawing */
-  for(v=sy/th,j=y-(sy&(th-1));j<h;v++,j+=th)
+  /* Start at the tile under the top left corner, skip any off the map */
+  u0=first_tile(sx,tw,&i0);
+  i0=x-i0;
+  if(u0<0)
   {
-    for(u=sx/tw,i=x-(sx&(tw-1));i<w;u++,i+=tw)
+    i0-=u0*tw;
+    u0=0;
+  }
+
+  v0=first_tile(sy,th,&j0);
+  j0=y-j0;
+  if(v0<0)
+  {
+    j0-=v0*th;
+    v0=0;
+  }
+
+  /* Do drawing, up to the last tile partly in view */
+  for(v=v0,j=j0;j<h&&v<mh;v++,j+=th)
+  {
+    for(u=u0,i=i0;i<w&&u<mw;u++,i+=tw)
     {
-      index=tls[(int)(dat[v*mw+u])].index;
+      index=tls[getcell_map(m,v*mw+u)].index;
       if(index||opaque)
-        draw_sprite(i,j,index,spr,x,y,w,h);
+        queue_sprite(LAYER_MAP,i,j,index,spr,x,y,w,h);
     }
   }
 }
+
+MAP_VIEW* new_map_view(Map *m, SPRITE *spr, int w, int h)
+{
+  MAP_VIEW *v;
+
+  v = (MAP_VIEW *) malloc(sizeof(MAP_VIEW));
+  if (v == NULL)
+    return NULL;
+
+  v->m = m;
+  v->spr = spr;
+  v->canvas = NULL;
+  v->w = w;
+  v->h = h;
+
+  /* One more tile each way for a view between tile boundaries */
+  v->cols = (w + m->tw - 1) / m->tw + 1;
+  v->rows = (h + m->th - 1) / m->th + 1;
+  v->u0 = v->v0 = 0;
+  v->valid = 0;
+
+  return v;
+}
+
+void free_map_view(MAP_VIEW *v)
+{
+  if (v->canvas != NULL)
+    free_sprite(v->canvas);
+  free(v);
+}
+
+static void draw_cell(MAP_VIEW *v, int u, int w)
+{
+  Map *m = v->m;
+
+  if (u < 0 || w < 0 || u >= m->w || w >= m->h)
+    return;
+
+  draw_sprite((u - v->u0) * m->tw, (w - v->v0) * m->th,
+              m->tiles[getcell_map(m, w * m->w + u)].index, v->spr,
+              0, 0, v->canvas->w, v->canvas->h);
+  METRIC_INC(MC_MAP_TILES);
+}
+
+void draw_map_view(MAP_VIEW *v, int x, int y, int sx, int sy)
+{
+  Map *m = v->m;
+  int u, w, u0, v0, ox, oy, i;
+
+  /* The canvas takes its format from the sheet, draw directly until then */
+  if (v->canvas == NULL && v->spr->state == SPRITE_READY)
+    v->canvas = new_sprite(v->cols * m->tw, v->rows * m->th, v->spr);
+
+  if (v->canvas == NULL)
+  {
+    draw_map(x, y, v->w, v->h, 1, m, sx, sy, v->spr);
+    return;
+  }
+
+  u0 = first_tile(sx, m->tw, &ox);
+  v0 = first_tile(sy, m->th, &oy);
+
+  set_sprite_target(v->canvas, 0);
+
+  /* Scrolling past a tile boundary draws the canvas again, otherwise only
+     the cells that changed */
+  if (!v->valid || m->all_dirty || u0 != v->u0 || v0 != v->v0)
+  {
+    v->u0 = u0;
+    v->v0 = v0;
+    for (w = v0; w < v0 + v->rows; w++)
+      for (u = u0; u < u0 + v->cols; u++)
+        draw_cell(v, u, w);
+    v->valid = 1;
+  }
+  else
+  {
+    for (i = 0; i < m->num_dirty; i++)
+    {
+      u = m->dirty_list[i] % m->w;
+      w = m->dirty_list[i] / m->w;
+      if (u >= u0 && u < u0 + v->cols && w >= v0 && w < v0 + v->rows)
+        draw_cell(v, u, w);
+    }
+  }
+
+  set_sprite_target(NULL, 0);
+  clean_map(m);
+
+  queue_sprite(LAYER_MAP, x - ox, y - oy, 0, v->canvas, x, y, v->w, v->h);
+}
@@ -26,6 +26,25 @@
 #ifndef _draw_map_h
 #define _draw_map_h
 
+/* Opaque map layer kept on a sprite, only changed cells are drawn again */
+typedef struct
+{
+  Map *m;
+  SPRITE *spr;
+  SPRITE *canvas;
+
+  /* Size of the view in pixels and in whole tiles held by the canvas */
+  int w, h;
+  int cols, rows;
+
+  /* Map tile at the top left of the canvas, and whether it is drawn */
+  int u0, v0;
+  int valid;
+} MAP_VIEW;
+
+extern MAP_VIEW* new_map_view(Map *m, SPRITE *spr, int w, int h);
+extern void free_map_view(MAP_VIEW *v);
+extern void draw_map_view(MAP_VIEW *v, int x, int y, int sx, int sy);
 extern void draw_map(int x,int y, int w, int h, int opaque,
 		     Map *m, int sx, int sy, SPRITE *spr);
 
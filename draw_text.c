@@ -20,6 +20,11 @@
 
 /*
  * draw_text.c -- 2d text engine
+ *
+ * Text that is drawn with a box is laid out once and kept in a small
+ * cache keyed by the string and the font.  Each line is pre-rendered
+ * into its own sprite when the sprite engine supports it, so drawing
+ * static text costs one blit per line and no allocations.
  */
 
 #include <stdio.h>
@@ -29,6 +34,30 @@
 #include "sprite.h"
 #include "draw_text.h"
 
+#define TEXT_CACHE_SIZE  32
+#define TEXT_MAX_LINES   64
+
+typedef struct {
+  const char *str;
+  int len;
+  SPRITE *img;
+} TEXT_LINE;
+
+typedef struct {
+  FONT *fnt;
+  unsigned long hash;
+  unsigned long used;
+
+  /* The original string followed by a copy split at newlines */
+  char *text;
+
+  int n, width;
+  TEXT_LINE line[TEXT_MAX_LINES];
+} TEXT_LAYOUT;
+
+static TEXT_LAYOUT text_cache[TEXT_CACHE_SIZE];
+static unsigned long text_clock;
+
 FONT *load_font(const char *fn, int w, int h)
 {
   FONT *fnt;
@@ -53,6 +82,7 @@ FONT *load_font(const char *fn, int w, int h)
 
 void free_font(FONT *fnt)
 {
+  flush_text_cache(fnt);
   free_sprite(fnt->img);
 }
 
@@ -69,50 +99,136 @@ void draw_text_line(int x, int y, const char *msg, FONT *fnt)
 
   /* Draw a sprite for each character */
   for (i = 0; i < len; i++) {
-    draw_sprite(dx, dy, msg[i] - ' ', fnt->img,
-		0, 0, window_width, window_height);
+    queue_sprite(LAYER_TEXT, dx, dy, msg[i] - ' ', fnt->img,
+		 0, 0, window_width, window_height);
     dx += fw;
   }
 
 }
 
-static int get_strings(char **str, char *msg, int *width, FONT *fnt)
+static unsigned long hash_text(const char *msg)
 {
-  char *token;
-  char tmp[255];
-  int w, fw, max_width = 0, n = 0;
+  unsigned long h = 2166136261UL;
+
+  while (*msg)
+    h = (h ^ (unsigned char) *msg++) * 16777619UL;
+
+  return h;
+}
+
+static void release_layout(TEXT_LAYOUT *lay)
+{
+  int i;
 
-  /* Separate a continuous string to multiple strings ending at newlines */
+  for (i = 0; i < lay->n; i++)
+    if (lay->line[i].img != NULL)
+      free_sprite(lay->line[i].img);
+
+  free(lay->text);
+  memset(lay, 0, sizeof(TEXT_LAYOUT));
+}
+
+void flush_text_cache(FONT *fnt)
+{
+  int i;
+
+  /* Drop all layouts for a font, or everything for NULL */
+  for (i = 0; i < TEXT_CACHE_SIZE; i++)
+    if (text_cache[i].text != NULL && (fnt == NULL || text_cache[i].fnt == fnt))
+      release_layout(&text_cache[i]);
+}
+
+static SPRITE *render_line(const char *str, int len, FONT *fnt)
+{
+  SPRITE *spr;
+  int i, fw;
 
-  /* Find first newline token */
-  strcpy(tmp, msg);
-  token = strtok(tmp, "\n");
   fw = fnt->img->w;
 
-  /* Separate string at newline tokens */
-  while (token != NULL) {
+  spr = new_sprite(fw * len, fnt->img->h, fnt->img);
+  if (spr == NULL)
+    return NULL;
+
+  /* Copy the glyphs of the line into the sprite */
+  set_sprite_target(spr, 0);
+  for (i = 0; i < len; i++)
+    draw_sprite(i * fw, 0, str[i] - ' ', fnt->img, 0, 0, spr->w, spr->h);
+  set_sprite_target(NULL, 0);
+
+  return spr;
+}
+
+static TEXT_LAYOUT *get_layout(const char *msg, FONT *fnt)
+{
+  TEXT_LAYOUT *lay, *victim;
+  unsigned long h;
+  char *token;
+  int i, len;
+
+  h = hash_text(msg);
+  victim = &text_cache[0];
+
+  for (i = 0; i < TEXT_CACHE_SIZE; i++) {
+
+    lay = &text_cache[i];
+    if (lay->text != NULL && lay->hash == h && lay->fnt == fnt &&
+        strcmp(lay->text, msg) == 0) {
+      lay->used = ++text_clock;
+      return lay;
+    }
+
+    /* Replace the least recently used layout */
+    if (lay->used < victim->used)
+      victim = lay;
+  }
+
+  lay = victim;
+  if (lay->text != NULL)
+    release_layout(lay);
+
+  len = strlen(msg);
+  lay->text = malloc(2 * (len + 1));
+  if (lay->text == NULL) {
+    fprintf(stderr, "Error -- Unable to layout text\n");
+    return NULL;
+  }
+
+  strcpy(lay->text, msg);
+  strcpy(lay->text + len + 1, msg);
 
-    w = fw * strlen(token);
-    if (max_width < w) max_width = w;
+  lay->fnt = fnt;
+  lay->hash = h;
+  lay->used = ++text_clock;
 
-    str[n] = malloc(strlen(token));
-    strcpy(str[n], token);
-    n++;
+  /* Separate the copy at newlines, empty lines are skipped */
+  token = strtok(lay->text + len + 1, "\n");
+  while (token != NULL && lay->n < TEXT_MAX_LINES) {
 
+    lay->line[lay->n].str = token;
+    lay->line[lay->n].len = strlen(token);
+    lay->line[lay->n].img = render_line(token, lay->line[lay->n].len, fnt);
+
+    if (lay->width < fnt->img->w * lay->line[lay->n].len)
+      lay->width = fnt->img->w * lay->line[lay->n].len;
+
+    lay->n++;
     token = strtok(NULL, "\n");
   }
 
-  *width = max_width;
-  return n;
+  return lay;
 }
 
-static void free_strings(char **str, int n)
+static void draw_layout(int x, int y, TEXT_LAYOUT *lay, FONT *fnt)
 {
   int i;
 
-  /* Free separated strings */
-  for (i = 0; i < n; i++)
-    free(str[i]);
+  for (i = 0; i < lay->n; i++, y += fnt->img->h) {
+    if (lay->line[i].img != NULL)
+      queue_sprite(LAYER_TEXT, x, y, 0, lay->line[i].img,
+		   0, 0, window_width, window_height);
+    else
+      draw_text_line(x, y, lay->line[i].str, fnt);
+  }
 }
 
 void draw_text_background(int x, int y, int w, int h, FONT *fnt)
@@ -124,112 +240,91 @@ void draw_text_background(int x, int y, int w, int h, FONT *fnt)
   fh = fnt->img->h;
 
   /* Draw four corners for the box */
-  draw_sprite(x, y, TEXTBOX_TOPLEFT_SPRITE, fnt->img,
-	      0, 0, window_width, window_height);
-  draw_sprite(x + w + fw, y, TEXTBOX_TOPRIGHT_SPRITE, fnt->img,
-	      0, 0, window_width, window_height);
-  draw_sprite(x, y + h + fh, TEXTBOX_BOTTOMLEFT_SPRITE, fnt->img,
-	      0, 0, window_width, window_height);
-  draw_sprite(x + w + fw, y + h+ fh, TEXTBOX_BOTTOMRIGHT_SPRITE, fnt->img,
-	      0, 0, window_width, window_height);
+  queue_sprite(LAYER_PANEL, x, y, TEXTBOX_TOPLEFT_SPRITE, fnt->img,
+	       0, 0, window_width, window_height);
+  queue_sprite(LAYER_PANEL, x + w + fw, y, TEXTBOX_TOPRIGHT_SPRITE, fnt->img,
+	       0, 0, window_width, window_height);
+  queue_sprite(LAYER_PANEL, x, y + h + fh, TEXTBOX_BOTTOMLEFT_SPRITE, fnt->img,
+	       0, 0, window_width, window_height);
+  queue_sprite(LAYER_PANEL, x + w + fw, y + h+ fh, TEXTBOX_BOTTOMRIGHT_SPRITE, fnt->img,
+	       0, 0, window_width, window_height);
 
   /* Draw left column */
   for (i = fh; i <= h; i += fh)
-    draw_sprite(x, y + i, TEXTBOX_LEFT_SPRITE, fnt->img,
-	        0, 0, window_width, window_height);
+    queue_sprite(LAYER_PANEL, x, y + i, TEXTBOX_LEFT_SPRITE, fnt->img,
+		 0, 0, window_width, window_height);
 
   /* Draw top row */
   for (i = fw; i <= w; i += fw)
-    draw_sprite(x + i, y, TEXTBOX_TOP_SPRITE, fnt->img,
-	        0, 0, window_width, window_height);
+    queue_sprite(LAYER_PANEL, x + i, y, TEXTBOX_TOP_SPRITE, fnt->img,
+		 0, 0, window_width, window_height);
 
   /* Draw right column */
   for (i = fh; i <= h; i += fh)
-    draw_sprite(x + w + fw, y + i, TEXTBOX_RIGHT_SPRITE, fnt->img,
-	        0, 0, window_width, window_height);
+    queue_sprite(LAYER_PANEL, x + w + fw, y + i, TEXTBOX_RIGHT_SPRITE, fnt->img,
+		 0, 0, window_width, window_height);
 
   /* Draw bottom row */
   for (i = fw; i <= w; i += fw)
-    draw_sprite(x + i, y + h + fh, TEXTBOX_BOTTOM_SPRITE, fnt->img,
-	        0, 0, window_width, window_height);
+    queue_sprite(LAYER_PANEL, x + i, y + h + fh, TEXTBOX_BOTTOM_SPRITE, fnt->img,
+		 0, 0, window_width, window_height);
 
   /* Draw background */
   for (j = fh; j <= h; j += fh)
     for (i = fw; i <= w; i += fw)
-      draw_sprite(x + i, y + j, TEXTBOX_BACKGROUND_SPRITE, fnt->img,
-	          0, 0, window_width, window_height);
+      queue_sprite(LAYER_PANEL, x + i, y + j, TEXTBOX_BACKGROUND_SPRITE, fnt->img,
+		   0, 0, window_width, window_height);
 
 }
 
 static void draw_menu_foreground(int x, int y, int r, int c, FONT *fnt)
 {
-  draw_sprite( x + fnt->img->w * c, y + fnt->img->h * r, TEXTBOX_LEFTARROW_SPRITE, fnt->img,
-	      0, 0, window_width, window_height);
+  queue_sprite(LAYER_TEXT, x + fnt->img->w * c, y + fnt->img->h * r, TEXTBOX_LEFTARROW_SPRITE, fnt->img,
+	       0, 0, window_width, window_height);
 }
 
 void draw_text_box(int x, int y, char *msg, FONT *fnt)
 {
-  int i, n;
-  int xp, yp, width, height;
-  char *str[64];
-
-  /* Store font height */
-  height = fnt->img->h;
+  TEXT_LAYOUT *lay;
 
-  /* Cut string to multiple strings ending at newline tokens */
   /* Width will be equal to total maximal length of string lines in pixels */
-  n = get_strings(str, msg, &width, fnt);
+  lay = get_layout(msg, fnt);
+  if (lay == NULL)
+    return;
 
-  draw_text_background(x, y, width, height * n, fnt);
-
-  /* Recalculate positions */
-  xp = x + fnt->img->w;
-  yp = y + fnt->img->h;
+  draw_text_background(x, y, lay->width, fnt->img->h * lay->n, fnt);
 
   /* Draw text strings */
-  for ( i = 0; i < n; i++, yp += height) {
-    draw_text_line(xp, yp, str[i], fnt);
-  }
-
-  /* Free temporary strings */
-  free_strings(str, n);
+  draw_layout(x + fnt->img->w, y + fnt->img->h, lay, fnt);
 }
 
 void draw_fixed_text(int x, int y, int w, char *msg, FONT *fnt)
 {
+  TEXT_LAYOUT *lay;
+
   draw_text_background(x, y, w, fnt->img->h, fnt);
 
-  draw_text_line(x, y + fnt->img->h, msg, fnt);
+  lay = get_layout(msg, fnt);
+  if (lay == NULL)
+    return;
+
+  draw_layout(x, y + fnt->img->h, lay, fnt);
 }
 
 void draw_menu_box(int x, int y, char *msg, int r, int c, FONT *fnt)
 {
-  int i, n;
-  int xp, yp, width, height;
-  char *str[64];
+  TEXT_LAYOUT *lay;
 
-  /* Store font height */
-  height = fnt->img->h;
-
-  /* Cut string to multiple strings ending at newline tokens */
   /* Width will be equal to total maximal length of string lines in pixels */
-  n = get_strings(str, msg, &width, fnt);
-
-  draw_text_background(x, y, width, height * n, fnt);
+  lay = get_layout(msg, fnt);
+  if (lay == NULL)
+    return;
 
-  /* Recalculate positions */
-  xp = x + fnt->img->w;
-  yp = y + fnt->img->h;
+  draw_text_background(x, y, lay->width, fnt->img->h * lay->n, fnt);
 
   /* Draw text strings */
-  for ( i = 0; i < n; i++, yp += height) {
-    draw_text_line(xp, yp, str[i], fnt);
-  }
+  draw_layout(x + fnt->img->w, y + fnt->img->h, lay, fnt);
 
   /* Draw marker */
   draw_menu_foreground(x, y, r, c, fnt);
-
-  /* Free temporary strings */
-  free_strings(str, n);
 }
-
@@ -44,6 +44,7 @@ typedef struct {
 
 FONT *load_font(const char *fn, int w, int h);
 void free_font(FONT *fnt);
+void flush_text_cache(FONT *fnt);
 void draw_text_line(int x, int y, const char *msg, FONT *fnt);
 void draw_text_background(int x, int y, int w, int h, FONT *fnt);
 void draw_fixed_text(int x, int y, int w, char *msg, FONT *fnt);
@@ -21,9 +21,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "sprite.h"
 #include "map.h"
 #include "draw_map.h"
+#include "metrics.h"
+#include "validate.h"
+#include "chunk.h"
 #include "main.h"
 
 
@@ -31,19 +35,32 @@
  * Local variables.
  */
 
-static byte existence_chance;
-static byte map[MAP_W][MAP_H];
-static int start_tile;
 static SPRITE *tiles;
-static Map *tile_map;
-
+static MAP_VIEW *map_view;
+static __thread struct cell revealed[MAP_W * MAP_H];
 
 
 /*
- * The complete dungeon structure
+ * A level as built from its description, kept while it is the current
+ * level so its chunks can be copied from it.
  */
 
-struct dungeon_complex d;
+struct built_level
+{
+  byte map[MAP_W][MAP_H];
+  byte gfx[MAP_W][MAP_H];
+};
+
+/* What the chunks of one level are generated from. */
+
+struct level_source
+{
+  struct session *s;
+  byte dl;
+  struct built_level *built;
+};
+
+
 
 
 /*
@@ -51,14 +68,7 @@ struct dungeon_complex d;
  */
 
 void create_complete_dungeon(void);
-void dig_level(void);
-void dig_section(coord, coord);
-void dig_stairs(void);
-void connect_sections(coord, coord, coord, coord, byte);
-void get_random_section(coord *, coord *);
-
-byte rand_door(void);
-BOOL dir_possible(coord, coord, byte);
+static void autotile_column(const byte *, byte *);
 
 
 
@@ -70,17 +80,37 @@ BOOL dir_possible(coord, coord, byte);
 
 void init_dungeon(void)
 {
+  int w = SCREEN_W, h = SCREEN_H - MSG_H - STATUS_H;
+
   create_complete_dungeon();
 
-  tiles = load_sprite("tiles.png", TILE_WIDTH, TILE_HEIGHT);
-  if (tiles == NULL) {
-    exit(1);
-  }
+  /* Sessions that are not drawn only need the view size. */
+  if (session->render)
+  {
+    tiles = get_sprite("tiles.png", TILE_WIDTH, TILE_HEIGHT, SPRITE_ASYNC);
+    if (tiles == NULL) {
+      exit(1);
+    }
 
-  tile_map = new_map(TILE_WIDTH, TILE_HEIGHT, TOTAL_NUM_TILES, MAP_W, MAP_H);
-  if (tile_map == NULL) {
-    exit(1);
+    session->tile_map = new_map(TILE_WIDTH, TILE_HEIGHT, TOTAL_NUM_TILES,
+                                MAP_W, MAP_H);
+    if (session->tile_map == NULL) {
+      exit(1);
+    }
+
+    map_view = new_map_view(session->tile_map, tiles,
+                            screen_width, screen_height);
+    if (map_view == NULL) {
+      exit(1);
+    }
+
+    w = screen_width;
+    h = screen_height;
   }
+
+  init_camera(&session->camera, w, h, TILE_WIDTH, TILE_HEIGHT,
+              MAP_W * TILE_WIDTH, MAP_H * TILE_HEIGHT,
+              CAMERA_DEADZONE_W, CAMERA_DEADZONE_H, CAMERA_SMOOTH);
 }
 
 
@@ -91,481 +121,220 @@ void init_dungeon(void)
 
 void create_complete_dungeon(void)
 {
+  byte map[MAP_W][MAP_H];
+  rand_type state;
+
+  /* Each level is generated from its own seed so it can be reproduced. */
+  state = get_rand_state();
+
+  /* Nothing is known about the dungeon at this point. */
+  free_level_maps(session);
+
   for (d.dl = 0; d.dl < MAX_DUNGEON_LEVEL; d.dl++)
   {
-    coord x, y;
-
     /* Basic initialization. */
 
-    /* Nothing is known about the dungeon at this point. */
-    for (x = 0; x < MAP_W; x++)
-      for (y = 0; y < MAP_H; y++)
-	set_knowledge(x, y, 0);
+    /* And nothing was changed yet. */
+    d.delta[d.dl].n = 0;
 
-    /* Create the current level map. */
-    dig_level();
+    /* Create the current level map, rejecting levels that are cut off. */
+    if (!generate_level(&d.lv[d.dl], d.seed, d.dl, map))
+      die("Unable to create a connected level");
 
     /* Note the current level as unvisited. */
     d.visited[d.dl] = FALSE;
   }
+
+  set_rand_state(state);
 }
 
 
 
 /*
- * Create one single dungeon level.
+ * Calculate the room width for a specific room section at (x, y).
  */
 
-void dig_level(void)
+int room_width(coord x, coord y)
 {
-  coord w, h, sectx[SECT_NUMBER], secty[SECT_NUMBER];
-  int16 i, index[SECT_NUMBER];
-
-  /*
-   * Determine a random order for the section generation.
-   */
-
-  /* Initial order. */
-  i = 0;
-  for (w = 0; w < NSECT_W; w++)
-    for (h = 0; h < NSECT_H; h++)
-    {
-      index[i] = i;
-      sectx[i] = w;
-      secty[i] = h;
-      i++;
-    }
-
-  /* Randomly shuffle the initial order. */
-  for (i = 0; i < SECT_NUMBER; i++)
-  {
-    int16 j, k, dummy;
+  return (d.lv[d.dl].s[x][y].rx2 - d.lv[d.dl].s[x][y].rx1 - 1);
+}
 
-    j = rand_int(SECT_NUMBER);
-    k = rand_int(SECT_NUMBER);
 
-    dummy = index[j];
-    index[j] = index[k];
-    index[k] = dummy;
-  }
-  
-  /*
-   * Create each section separately.
-   */
-  
-  /* Initially there is a 30% chance for rooms to be non-existant. */
-  existence_chance = 70;
 
-  /* Dig each section. */
-  for (i = 0; i < SECT_NUMBER; i++)
-    dig_section(sectx[index[i]], secty[index[i]]);
+/*
+ * Calculate the room height for a specific room section at (x, y).
+ */
 
-  /* Build some stairs. */
-  dig_stairs();
+int room_height(coord x, coord y)
+{
+  return (d.lv[d.dl].s[x][y].ry2 - d.lv[d.dl].s[x][y].ry1 - 1);
 }
 
 
 
 /*
- * Dig one section for the dungeon.
- *
- * The game assumes that one section is SECT_W * SECT_H tiles in size.
- * A section can contain a room with up to four doors or simply be an
- * intersction of several passages.
+ * Fill one chunk of a level and its graphical tiles.
  *
+ * The first chunk needed after entering the level builds the level from
+ * its section descriptions and the changes made to it; the others are
+ * copied from that.  Cells past the edge of the map are rock.
  */
 
-void dig_section(coord x, coord y)
+static void level_chunk(void *ctx, int cx, int cy, unsigned char *cells,
+                        unsigned char *gfx)
 {
-  if (rand_byte(100) + 1 >= existence_chance)
+  struct level_source *src = ctx;
+  struct built_level *b = src->built;
+  int i, j, x, y;
+
+  if (b == NULL)
   {
-    /* No room here. */
-    d.s[d.dl][x][y].exists = FALSE;
+    b = src->built = malloc(sizeof(struct built_level));
+    if (b == NULL)
+      die("Out of memory for the level map");
 
-    /* Decrease the chance for further empty rooms. */
-    existence_chance += 3;
+    build_level(&src->s->dungeon.lv[src->dl], src->dl, b->map);
+    apply_delta(&src->s->dungeon.delta[src->dl], b->map);
+
+    /* Determine the graphical tile of every cell once. */
+    for (x = 0; x < MAP_W; x++)
+      autotile_column(b->map[x], b->gfx[x]);
+
+    METRIC_INC(MC_LEVEL_BUILDS);
   }
-  else
-  {
-    byte dir;
-
-    /* Yeah :-) ! */
-    d.s[d.dl][x][y].exists = TRUE;
-
-    /*
-     * Dig a room.
-     *
-     * Rooms are at least 4x4 tiles in size.
-     */
-    
-    do
+
+  for (j = 0; j < CHUNK_SIZE; j++)
+    for (i = 0; i < CHUNK_SIZE; i++)
     {
-      d.s[d.dl][x][y].rx1 = x * SECT_W + rand_byte(3) + 1;
-      d.s[d.dl][x][y].ry1 = y * SECT_H + rand_byte(3) + 1;
-      d.s[d.dl][x][y].rx2 = (x + 1) * SECT_W - rand_byte(3) - 2;
-      d.s[d.dl][x][y].ry2 = (y + 1) * SECT_H - rand_byte(3) - 2;
-    }
-    while (d.s[d.dl][x][y].rx2 - d.s[d.dl][x][y].rx1
-	   < 3 ||
-	   d.s[d.dl][x][y].ry2 - d.s[d.dl][x][y].ry1
-	   < 3);
-
-    /*
-     * Create doors.
-     *
-     * XXX: At some point it would be nice to create doors only for
-     *      some directions to make the dungeon less regular.
-     */
-    
-    for (dir = N; dir <= E; dir++)
-      if (dir_possible(x, y, dir))
+      x = (cx << CHUNK_SHIFT) + i;
+      y = (cy << CHUNK_SHIFT) + j;
+      if (x < MAP_W && y < MAP_H)
       {
-	switch (dir)
-	{
-	  case N:
-	    d.s[d.dl][x][y].dx[dir] = d.s[d.dl][x][y].rx1 +
-	      rand_byte(room_width(x, y) - 1) + 1;
-	    d.s[d.dl][x][y].dy[dir] = d.s[d.dl][x][y].ry1;
-	    break;
-
-	  case S:
-	    d.s[d.dl][x][y].dx[dir] = d.s[d.dl][x][y].rx1 +
-	      rand_byte(room_width(x, y) - 1) + 1;
-	    d.s[d.dl][x][y].dy[dir] = d.s[d.dl][x][y].ry2;
-	    break;
-	    
-	  case E:
-	    d.s[d.dl][x][y].dy[dir] = d.s[d.dl][x][y].ry1 +
-	      rand_byte(room_height(x, y) - 1) + 1;
-	    d.s[d.dl][x][y].dx[dir] = d.s[d.dl][x][y].rx2;
-	    break;
-	    
-	  case W:
-	    d.s[d.dl][x][y].dy[dir] = d.s[d.dl][x][y].ry1 +
-	      rand_byte(room_height(x, y) - 1) + 1;
-	    d.s[d.dl][x][y].dx[dir] = d.s[d.dl][x][y].rx1;
-	    break;
-	    
-	  default:
-	    break;
-	}
-	d.s[d.dl][x][y].dt[dir] = FLOOR; /* No doors for now: rand_door();*/
+        cells[j * CHUNK_SIZE + i] = b->map[x][y];
+        gfx[j * CHUNK_SIZE + i] = b->gfx[x][y];
       }
       else
-	d.s[d.dl][x][y].dt[dir] = NO_DOOR;
-  }
+        cells[j * CHUNK_SIZE + i] = ROCK;
+    }
 }
 
 
 
 /*
- * Calculate the room width for a specific room section at (x, y).
+ * Create the chunk store of level 'dl'.
  */
 
-int room_width(coord x, coord y)
+static struct chunk_store *new_level_map(byte dl)
 {
-  return (d.s[d.dl][x][y].rx2 - d.s[d.dl][x][y].rx1 - 1);
-}
+  struct level_source *src;
+  struct chunk_store *s;
 
+  src = calloc(1, sizeof(struct level_source));
+  if (src == NULL)
+    return NULL;
 
+  src->s = session;
+  src->dl = dl;
 
-/*
- * Calculate the room height for a specific room section at (x, y).
- */
+  s = new_chunk_store(MAP_W, MAP_H, LEVEL_CHUNKS, ROCK, level_chunk, src);
+  if (s == NULL)
+    free(src);
 
-int room_height(coord x, coord y)
-{
-  return (d.s[d.dl][x][y].ry2 - d.s[d.dl][x][y].ry1 - 1);
+  return s;
 }
 
 
 
 /*
- * Determine a random door type.
+ * Forget the built copy of a level that is no longer the current one.
  */
 
-byte rand_door(void)
+static void drop_built_level(struct chunk_store *s)
 {
-  byte roll = rand_byte(100);
-
-  if (roll < 75)
-    return OPEN_DOOR;
-  else if (roll < 90)
-    return CLOSED_DOOR;
+  struct level_source *src = s->ctx;
 
-  return LOCKED_DOOR;
+  free(src->built);
+  src->built = NULL;
 }
 
 
 
 /*
- * Build a map for the current dungeon level.
- *
- * This function is very important for QHack in general.  Levels are only
- * stored by their section descriptions.  The actual map is created when the
- * level is entered.  The positive thing about this is that it requires much
- * less space to save a level in this way (since you only need the outline
- * descriptions).  The negative thing is that tunneling and other additions
- * are not possible since the level desciptions have now way of recording
- * them.
+ * Free the maps of all levels of session 's'.
  */
 
-void build_map(void)
+void free_level_maps(struct session *s)
 {
-  coord x, y, sx, sy;
-  byte dir;
-  
-  /* Basic initialization. */
-  for (x = 0; x < MAP_W; x++)
-    for (y = 0; y < MAP_H; y++)
-      map[x][y] = ROCK;
-
-  /* Build each section. */
-  for (sx = 0; sx < NSECT_W; sx++)
-    for (sy = 0; sy < NSECT_H; sy++)
-    {
-      /* Handle each section. */
-      if (d.s[d.dl][sx][sy].exists)
-      {
-	/* Paint existing room. */
-	for (x = d.s[d.dl][sx][sy].rx1 + 1;
-	     x < d.s[d.dl][sx][sy].rx2;
-	     x++)
-	  for (y = d.s[d.dl][sx][sy].ry1 + 1;
-	       y < d.s[d.dl][sx][sy].ry2;
-	       y++)
-	    map[x][y] = FLOOR;
-
-	/* Paint doors. */
-	for (dir = N; dir <= E; dir++)
-	  if (d.s[d.dl][sx][sy].dt[dir] != NO_DOOR)
-	    map[d.s[d.dl][sx][sy].dx[dir]][d.s[d.dl][sx][sy].dy[dir]]
-	      = d.s[d.dl][sx][sy].dt[dir];
-      }
-    }
+  int i;
 
-
-  /* Connect each section. */
-  for (sx = 0; sx < NSECT_W; sx++)
-    for (sy = 0; sy < NSECT_H; sy++)
+  for (i = 0; i < MAX_DUNGEON_LEVEL; i++)
+    if (s->levels[i] != NULL)
     {
-      if (dir_possible(sx, sy, E))
-	connect_sections(sx, sy, sx + 1, sy, E);
-      if (dir_possible(sx, sy, S))
-	connect_sections(sx, sy, sx, sy + 1, S);
+      drop_built_level(s->levels[i]);
+      free(s->levels[i]->ctx);
+      free_chunk_store(s->levels[i]);
+      s->levels[i] = NULL;
     }
-
-  /* Place the stairways. */
-  map[d.stxu[d.dl]][d.styu[d.dl]] = STAIR_UP;
-  if (d.dl < MAX_DUNGEON_LEVEL - 1)
-    map[d.stxd[d.dl]][d.styd[d.dl]] = STAIR_DOWN;
-
-  start_tile = d.dl * NUM_TILES;
-  clear_map(tile_map, start_tile + TILE_UNKNOWN);
 }
 
 
 
-
 /*
- * Connect two sections of a level.
+ * Build a map for the current dungeon level.
+ *
+ * This function is very important for QHack in general.  Levels are only
+ * stored by their section descriptions.  The actual map is created when the
+ * level is entered.  The positive thing about this is that it requires much
+ * less space to save a level in this way (since you only need the outline
+ * descriptions).  Tunneling and other changes are recorded in a small
+ * per-level list of changed tiles that is applied on top of the built map.
+ *
+ * The map is kept in chunks (see chunk.c) which are only built when a
+ * cell in them is looked at.
  */
 
-void connect_sections(coord sx1, coord sy1, coord sx2, coord sy2, byte dir)
+void build_map(void)
 {
-  coord cx1, cy1, cx2, cy2, mx, my, x, y;
-
-  /* Get the start coordinates from section #1. */ 
-  if (d.s[d.dl][sx1][sy1].exists)
-  {
-    if (dir == S)
-    {
-      cx1 = d.s[d.dl][sx1][sy1].dx[S];
-      cy1 = d.s[d.dl][sx1][sy1].dy[S];
-    }
-    else
-    {
-      cx1 = d.s[d.dl][sx1][sy1].dx[E];
-      cy1 = d.s[d.dl][sx1][sy1].dy[E];
-    }
-  }
-  else
-  {
-    cx1 = sx1 * SECT_W + (SECT_W >> 1);
-    cy1 = sy1 * SECT_H + (SECT_H >> 1);
-  }
+  int i;
 
-  /* Get the end coordinates from section #2. */ 
-  if (d.s[d.dl][sx2][sy2].exists)
-  {
-    if (dir == S)
-    {
-      cx2 = d.s[d.dl][sx2][sy2].dx[N];
-      cy2 = d.s[d.dl][sx2][sy2].dy[N];
-    }
-    else
-    {
-      cx2 = d.s[d.dl][sx2][sy2].dx[W];
-      cy2 = d.s[d.dl][sx2][sy2].dy[W];
-    }
-  }
-  else
-  {
-    cx2 = sx2 * SECT_W + (SECT_W >> 1);
-    cy2 = sy2 * SECT_H + (SECT_H >> 1);
-  }
+  if (d.dl < 0 || d.dl >= MAX_DUNGEON_LEVEL)
+    die("Illegal dungeon level");
 
-  /* Get the middle of the section. */
-  mx = (cx1 + cx2) >> 1;
-  my = (cy1 + cy2) >> 1;
+  /* Only the current level keeps its built copy. */
+  for (i = 0; i < MAX_DUNGEON_LEVEL; i++)
+    if (i != d.dl && session->levels[i] != NULL)
+      drop_built_level(session->levels[i]);
 
-  /* Draw the tunnel. */
-  x = cx1;
-  y = cy1;
-  if (dir == E)
+  if (session->levels[d.dl] == NULL)
   {
-    /* Part #1. */
-    while (x < mx)
-    {
-      if (map[x][y] == ROCK)
-	map[x][y] = FLOOR;
-      x++;
-    }
-
-    /* Part #2. */
-    if (y < cy2)
-      while (y < cy2)
-      {
-	if (map[x][y] == ROCK)
-	  map[x][y] = FLOOR;
-	y++;
-      }
-    else
-      while (y > cy2)
-      {
-	if (map[x][y] == ROCK)
-	  map[x][y] = FLOOR;
-	y--;
-      }
-    
-    /* Part #3. */
-    while (x < cx2)
-    {
-      if (map[x][y] == ROCK)
-	map[x][y] = FLOOR;
-      x++;
-    }
-    if (map[x][y] == ROCK)
-      map[x][y] = FLOOR;
+    session->levels[d.dl] = new_level_map(d.dl);
+    if (session->levels[d.dl] == NULL)
+      die("Unable to allocate the level map");
   }
-  else
-  {
-    /* Part #1. */
-    while (y < my)
-    {
-      if (map[x][y] == ROCK)
-	map[x][y] = FLOOR;
-      y++;
-    }
-    if (map[x][y] == ROCK)
-      map[x][y] = FLOOR;
 
-    /* Part #2. */
-    if (x < cx2)
-      while (x < cx2)
-      {
-	if (map[x][y] == ROCK)
-	  map[x][y] = FLOOR;
-	x++;
-      }
-    else
-      while (x > cx2)
-      {
-	if (map[x][y] == ROCK)
-	  map[x][y] = FLOOR;
-	x--;
-      }
-
-    /* Part #3. */
-    while (y < cy2)
-    {
-      if (map[x][y] == ROCK)
-	map[x][y] = FLOOR;
-      y++;
-    }
-  }
-  if (map[x][y] == ROCK)
-    map[x][y] = FLOOR;
+  session->start_tile = d.dl * NUM_TILES;
+  if (session->tile_map != NULL)
+    clear_map(session->tile_map, session->start_tile + TILE_UNKNOWN);
 }
 
 
 
 /*
- * Determine whether a given section is set on a border.
- */
-
-BOOL dir_possible(coord x, coord y, byte dir)
-{
-  return ((dir == N && y > 0) ||
-	  (dir == S && y < NSECT_H - 1) ||
-	  (dir == W && x > 0) ||
-	  (dir == E && x < NSECT_W - 1));
-}
-
-
-
-/*
- * Each level requires at least one stair!
+ * The map and knowledge of the current level.  Each level visited keeps
+ * a chunk store; its chunks are built from the level description when
+ * first needed and changed chunks spill to disk once more than
+ * LEVEL_CHUNKS are in use.
+ *
+ * There is no current level once the player left the dungeon; the map
+ * is solid rock then and nothing is known.
  */
 
-void dig_stairs(void)
+static struct chunk_store *current_level(void)
 {
-  coord sx, sy, x, y;
-  
-  /* Dig stairs upwards. */
-
-  /* Find a section. */
-  get_random_section(&sx, &sy);
-  
-  d.stxu[d.dl] = d.s[d.dl][sx][sy].rx1 +
-    rand_byte(room_width(sx, sy) - 1) + 1;
-  d.styu[d.dl] = d.s[d.dl][sx][sy].ry1 +
-    rand_byte(room_height(sx, sy) - 1) + 1;
-
-  /* Dig stairs downwards. */
-  if (d.dl < MAX_DUNGEON_LEVEL - 1)
-  {
-    /* Find a section. */
-    get_random_section(&sx, &sy);
-
-    /* Find a good location. */
-    do
-    {
-      x = d.s[d.dl][sx][sy].rx1 + rand_byte(room_width(sx, sy) - 1) + 1;
-      y = d.s[d.dl][sx][sy].ry1 + rand_byte(room_height(sx, sy) - 1) + 1;
-    }
-    while (d.dl && x == d.stxu[d.dl] && y == d.styu[d.dl]);
-
-    /* Place the stairway. */
-    d.stxd[d.dl] = x;
-    d.styd[d.dl] = y;
-  }
-}
-
-
-
-/*
- * Find a random section on the current dungeon level.
- */
+  if (d.dl < 0 || d.dl >= MAX_DUNGEON_LEVEL)
+    return NULL;
 
-void get_random_section(coord *sx, coord *sy)
-{
-  do
-  {
-    *sx = rand_int(NSECT_W);
-    *sy = rand_int(NSECT_H);
-  }
-  while (!d.s[d.dl][*sx][*sy].exists);
+  return session->levels[d.dl];
 }
 
 
@@ -576,7 +345,7 @@ void get_random_section(coord *sx, coord *sy)
 
 BOOL is_open(coord x, coord y)
 {
-  switch (map[x][y])
+  switch (tile_at(x, y))
   {
     case ROCK:
     case LOCKED_DOOR:
@@ -596,7 +365,7 @@ BOOL is_open(coord x, coord y)
 
 BOOL might_be_open(coord x, coord y)
 {
-  switch (map[x][y])
+  switch (tile_at(x, y))
   {
     case ROCK:
       return FALSE;
@@ -618,11 +387,26 @@ BOOL might_be_open(coord x, coord y)
 
 void know(coord x, coord y)
 {
-  if (is_known(x, y))
-    return;
+  know_area(x, y, x, y);
+}
+
+
+
+/*
+ * Memorize all locations in a rectangle and paint those that were not
+ * known before.
+ */
+
+void know_area(coord x1, coord y1, coord x2, coord y2)
+{
+  int i, n;
+
+  n = know_rect(x1, y1, x2, y2, revealed);
+
+  for (i = 0; i < n; i++)
+    paint_tile(revealed[i].x, revealed[i].y);
 
-  set_knowledge(x, y, 1);
-  paint_tile(x, y);
+  METRIC_ADD(MC_TILES_REVEALED, n);
 }
 
 
@@ -641,57 +425,98 @@ void paint_tile(coord x, coord y)
 static void puttile(int x, int y, int tile)
 {
   /* Error check */
-  if (x >= 0 && x <= MAP_W && y >= 0 && y <= MAP_H)
+  if (session->tile_map != NULL &&
+      x >= 0 && x < MAP_W && y >= 0 && y < MAP_H)
   {
-      puttile_map(tile_map, x, y, start_tile + tile);
+      puttile_map(session->tile_map, x, y, session->start_tile + tile);
   }
 }
 
+/*
+ * Determine the graphical tiles for one map column.
+ *
+ * Rock with floor below is drawn as a wall face and the cell above it shows
+ * the top of the wall.  Everything is computed on bit masks of the column,
+ * one bit per cell.
+ */
+
+static void autotile_column(const byte *col, byte *gfx)
+{
+  uint64_t floors, rocks, bottom, dense, over, over_dense, bit;
+  coord y;
+
+  floors = match_column(col, FLOOR);
+  rocks = match_column(col, ROCK);
+
+  /* Wall faces. */
+  bottom = rocks & (floors >> 1);
+
+  /* Rock under rock is solid, except inside a two cell wall between floors. */
+  dense = rocks & ~(floors << 1) & ~(uint64_t) 1 &
+          ~((floors << 2) & (floors >> 1));
+
+  /* The top of each wall face is drawn on the cell above. */
+  over = bottom >> 1;
+  over_dense = (bottom & dense) >> 1;
+
+  for (y = 0; y < MAP_H; y++)
+  {
+    bit = (uint64_t) 1 << y;
+
+    if (over & bit)
+      gfx[y] = (over_dense & bit) ? TILE_DENSE : TILE_TOP;
+    else if (bottom & bit)
+      gfx[y] = TILE_BOTTOM;
+    else if (dense & bit)
+      gfx[y] = TILE_DENSE;
+    else if (rocks & bit)
+      gfx[y] = TILE_TOP;
+    else if (col[y] == FLOOR)
+      gfx[y] = TILE_CLEAR;
+    else if (col[y] == STAIR_DOWN)
+      gfx[y] = TILE_STAIR_D;
+    else if (col[y] == STAIR_UP)
+      gfx[y] = TILE_STAIR_U;
+    else
+      gfx[y] = TILE_UNKNOWN;
+  }
+}
+
+
+
+/*
+ * Return the graphical tile of the cell at (x, y).
+ */
+
+int gfx_at(coord x, coord y)
+{
+  struct chunk_store *s = current_level();
+
+  return (s != NULL) ? chunk_gfx(s, x, y) : TILE_UNKNOWN;
+}
+
+
+
 /*
  * Paint the tile at position (x, y) to the current screen position.
  */
 
 void paint_tile_at_position(coord x, coord y)
 {
-  byte tile;
+  int tile;
 
-  if (x <  0 || y < 0 || x > MAP_W || y > MAP_H || !is_known(x, y))
+  if (x <  0 || y < 0 || x >= MAP_W || y >= MAP_H || !is_known(x, y))
   {
     puttile(x, y, TILE_UNKNOWN);
   }
   else
   {
-    tile = map[x][y];
-    if (tile == FLOOR)
-      puttile(x, y, TILE_CLEAR);
-    else if (tile == STAIR_DOWN)
-      puttile(x, y, TILE_STAIR_D);
-    else if (tile == STAIR_UP)
-      puttile(x, y, TILE_STAIR_U);
-    else if (tile == ROCK)
-    {
-      int above;
+    tile = gfx_at(x, y);
+    puttile(x, y, tile);
 
-      if (y-1 >= 0 && map[x][y-1] != FLOOR)
-      {
-        /* Test for special case, two vertical rocks */
-        if (y-2 >= 0 && map[x][y-2] == FLOOR &&
-            y+1 <= MAP_H && map[x][y+1] == FLOOR)
-          above = TILE_TOP;
-        else
-          above = TILE_DENSE;
-      }
-      else
-        above = TILE_TOP;
-
-      if (y+1 <= MAP_H && map[x][y+1] == FLOOR)
-      {
-        puttile(x, y-1, above);
-        puttile(x, y, TILE_BOTTOM);
-      }
-      else
-        puttile(x, y, above);
-    }
+    /* A wall face also shows the top of the wall above it. */
+    if (tile == TILE_BOTTOM && y > 0)
+      puttile(x, y - 1, gfx_at(x, y - 1));
   }
 }
 
@@ -705,15 +530,8 @@ void paint_tile_at_position(coord x, coord y)
 
 void know_section(coord sx, coord sy)
 {
-  coord x, y;
-
-  for (y = d.s[d.dl][sx][sy].ry1;
-       y <= d.s[d.dl][sx][sy].ry2;
-       y++)
-    for (x = d.s[d.dl][sx][sy].rx1;
-	 x <= d.s[d.dl][sx][sy].rx2;
-	 x++)
-      know(x, y);
+  know_area(d.lv[d.dl].s[sx][sy].rx1, d.lv[d.dl].s[sx][sy].ry1,
+	    d.lv[d.dl].s[sx][sy].rx2, d.lv[d.dl].s[sx][sy].ry2);
 }
 
 
@@ -740,11 +558,11 @@ void get_current_section(coord px, coord py, coord *sx, coord *sy)
 {
   get_current_section_coordinates(px, py, sx, sy);
   
-  if (!d.s[d.dl][*sx][*sy].exists ||
-      px < d.s[d.dl][*sx][*sy].rx1 ||
-      px > d.s[d.dl][*sx][*sy].rx2 ||
-      py < d.s[d.dl][*sx][*sy].ry1 ||
-      py > d.s[d.dl][*sx][*sy].ry2)
+  if (!d.lv[d.dl].s[*sx][*sy].exists ||
+      px < d.lv[d.dl].s[*sx][*sy].rx1 ||
+      px > d.lv[d.dl].s[*sx][*sy].rx2 ||
+      py < d.lv[d.dl].s[*sx][*sy].ry1 ||
+      py > d.lv[d.dl].s[*sx][*sy].ry2)
     *sx = *sy = -1;
 }
 
@@ -756,7 +574,9 @@ void get_current_section(coord px, coord py, coord *sx, coord *sy)
 
 char tile_at(coord x, coord y)
 {
-  return map[x][y];
+  struct chunk_store *s = current_level();
+
+  return (s != NULL) ? (char) chunk_cell(s, x, y) : ROCK;
 }
 
 
@@ -779,25 +599,62 @@ void paint_map(void)
 
 
 
+/*
+ * Change the tile at a given position.  The change is recorded with the
+ * level so it survives leaving and rebuilding it.  Returns FALSE if the
+ * level can't take any more changes.
+ */
+
+BOOL change_tile(coord x, coord y, byte tile)
+{
+  struct chunk_store *s = current_level();
+  struct level_source *src;
+  byte col[MAP_H], gfx[MAP_H];
+  coord i;
+
+  if (s == NULL || !set_delta(&d.delta[d.dl], x, y, tile, tile_at(x, y)))
+    return FALSE;
+
+  set_chunk_cell(s, x, y, tile);
+
+  /* Graphics depend on the cells two above and below. */
+  for (i = 0; i < MAP_H; i++)
+    col[i] = tile_at(x, i);
+  autotile_column(col, gfx);
+  for (i = imax(y - 2, 0); i <= imin(y + 2, MAP_H - 1); i++)
+    set_chunk_gfx(s, x, i, gfx[i]);
+
+  /* Chunks generated later are copied from the built level. */
+  src = s->ctx;
+  if (src->built != NULL)
+  {
+    src->built->map[x][y] = tile;
+    memcpy(src->built->gfx[x], gfx, MAP_H);
+  }
+
+  know(x, y);
+
+  /*
+   * Wall faces and tops depend on the cells two above and below, so the
+   * graphics from y - 2 to y + 2 may have changed.  Cells are painted
+   * from the top down so a wall face below an unknown cell paints its
+   * top again; y + 3 repaints the top it shows on y + 2.
+   */
+  for (i = imax(y - 2, 0); i <= imin(y + 3, MAP_H - 1); i++)
+    paint_tile_at_position(x, i);
+
+  return TRUE;
+}
+
+
+
 /*
  * Change a door at a given position to another type of door.
  */
 
 void change_door(coord x, coord y, byte door)
 {
-  coord sx, sy;
-  byte i;
-
-  get_current_section_coordinates(x, y, &sx, &sy);
-  
-  for (i = 0; i < 4; i++)
-    if (d.s[d.dl][sx][sy].dx[i] == x && d.s[d.dl][sx][sy].dy[i] == y)
-    {
-      d.s[d.dl][sx][sy].dt[i] = door;
-      map[x][y] = door;
-      set_knowledge(x, y, 0);
-      know(x, y);
-    }
+  change_tile(x, y, door);
 }
 
 
@@ -806,11 +663,128 @@ void change_door(coord x, coord y, byte door)
  * Determine whether a given position is already known.
  *
  * NOTE: The knowledge map is saved in a bit field to save some memory.
+ *       Each row of a map chunk is one word so that rectangles can be
+ *       handled with a few word operations.
  */
 
 BOOL is_known(coord x, coord y)
 {
-  return (BOOL) (d.known[d.dl][x >> 3][y] & (1 << (x % 8)));
+  struct chunk_store *s = current_level();
+
+  return (s != NULL) ? (BOOL) chunk_known(s, x, y) : FALSE;
+}
+
+
+
+/*
+ * Clip a rectangle to the map.  Returns FALSE if nothing is left.
+ */
+
+static BOOL clip_rect(coord *x1, coord *y1, coord *x2, coord *y2)
+{
+  if (*x1 < 0)
+    *x1 = 0;
+  if (*y1 < 0)
+    *y1 = 0;
+  if (*x2 > MAP_W - 1)
+    *x2 = MAP_W - 1;
+  if (*y2 > MAP_H - 1)
+    *y2 = MAP_H - 1;
+
+  return (*x1 <= *x2 && *y1 <= *y2);
+}
+
+
+
+/*
+ * Store the cells set in 'bits' of row y, bit 0 being column x.  Returns
+ * the number of cells.
+ */
+
+static int list_cells(coord x, coord y, uint32_t bits, struct cell *cells)
+{
+  int n = 0;
+
+  while (bits)
+  {
+    cells[n].x = x + __builtin_ctz(bits);
+    cells[n].y = y;
+    bits &= bits - 1;
+    n++;
+  }
+
+  return n;
+}
+
+
+
+/*
+ * Find the unknown cells in a rectangle, one chunk row at a time, and
+ * make them known if 'set'.  If 'cells' is not NULL it must have room for
+ * every cell of the rectangle.  Returns the number of unknown cells.
+ */
+
+static int scan_knowledge(coord x1, coord y1, coord x2, coord y2, BOOL set,
+                          struct cell *cells)
+{
+  struct chunk_store *s = current_level();
+  uint32_t mask, bits;
+  coord x, y, xe;
+  int n = 0;
+
+  if (s == NULL || !clip_rect(&x1, &y1, &x2, &y2))
+    return 0;
+
+  for (y = y1; y <= y2; y++)
+    for (x = x1; x <= x2; x = xe + 1)
+    {
+      /* Up to the end of the chunk. */
+      xe = imin(x2, x | CHUNK_MASK);
+      mask = ~(uint32_t) 0 >> (CHUNK_MASK - (xe - x));
+      bits = mask & ~chunk_known_span(s, x, xe, y, set);
+      if (cells)
+        n += list_cells(x, y, bits, cells + n);
+      else
+        n += __builtin_popcount(bits);
+    }
+
+  return n;
+}
+
+
+
+/*
+ * Determine whether a complete rectangle is already known.
+ */
+
+BOOL is_known_rect(coord x1, coord y1, coord x2, coord y2)
+{
+  return (scan_knowledge(x1, y1, x2, y2, FALSE, NULL) == 0);
+}
+
+
+
+/*
+ * Find the unknown cells in a rectangle.  If 'cells' is not NULL it must
+ * have room for every cell of the rectangle.  Returns the number of
+ * unknown cells.
+ */
+
+int diff_knowledge(coord x1, coord y1, coord x2, coord y2, struct cell *cells)
+{
+  return scan_knowledge(x1, y1, x2, y2, FALSE, cells);
+}
+
+
+
+/*
+ * Make a rectangle known.  The newly known cells are stored in 'cells'
+ * as with 'diff_knowledge' and their number is returned.
+ */
+
+int know_rect(coord x1, coord y1, coord x2, coord y2, struct cell *cells)
+{
+  return scan_knowledge(x1, y1, x2, y2, TRUE, cells);
 }
 
 
@@ -819,7 +793,7 @@ BOOL is_floor(coord x, coord y)
 {
   BOOL result = FALSE;
 
-  if (map[x][y] == FLOOR)
+  if (tile_at(x, y) == FLOOR)
     result = TRUE;
 
   return result;
@@ -833,43 +807,24 @@ BOOL is_floor(coord x, coord y)
 
 void set_knowledge(coord x, coord y, byte known)
 {
-  if (known)
-    d.known[d.dl][x >> 3][y] |= (1 << (x % 8));
-  else
-    d.known[d.dl][x >> 3][y] &= (~(1 << (x % 8)));
+  struct chunk_store *s = current_level();
+
+  if (s != NULL)
+    set_chunk_known(s, x, y, known);
 }
 
 void move_dungeon(void)
 {
-  int mw, mh;
-
-  get_screen_size_map(tile_map, &mw, &mh);
-
-  d.map_x = d.pa.x - screen_width / 2;
-  d.map_y = d.pa.y - screen_height / 2;
-
-  if (d.map_x < 0)
-  {
-    d.map_x = 0;
-  }
-  if (d.map_x > mw - screen_width)
-  {
-    d.map_x = mw - screen_width;
-  }
-
-  if (d.map_y < 0)
-  {
-    d.map_y = 0;
-  }
-  if (d.map_y > mh - screen_height)
-  {
-    d.map_y = mh - screen_height;
-  }
+  follow_camera(&session->camera, d.pa.x + TILE_WIDTH / 2,
+                d.pa.y + TILE_HEIGHT / 2);
 }
 
 void draw_dungeon(void)
 {
-  draw_map(0, 0, screen_width, screen_height, 1, tile_map,
-           d.map_x, d.map_y, tiles);
+  /*
+   * tiles.png has no animation frames yet, so no tile is animated and
+   * update_animations_map is not run.
+   */
+  draw_map_view(map_view, 0, 0, session->camera.x, session->camera.y);
 }
 
@@ -28,6 +28,7 @@
  */
 
 #include "sysdep.h"
+#include "camera.h"
 
 
 
@@ -70,6 +71,15 @@ enum direction
 
 #define TOTAL_NUM_TILES 128
 
+/*
+ * A map position.
+ */
+
+struct cell
+{
+  coord x, y;
+};
+
 /*
  * Global variables.
  */
@@ -79,6 +89,7 @@ extern byte dl;
 
 
 
+
 /*
  * Global functions.
  */
@@ -89,13 +100,20 @@ int room_height(coord, coord);
 BOOL is_open(coord, coord);
 BOOL might_be_open(coord, coord);
 BOOL is_known(coord, coord);
+BOOL is_known_rect(coord, coord, coord, coord);
+int diff_knowledge(coord, coord, coord, coord, struct cell *);
+int know_rect(coord, coord, coord, coord, struct cell *);
 
 char tile_at(coord, coord);
+int gfx_at(coord, coord);
 
 void init_dungeon(void);
 void build_map(void);
+struct session;
+void free_level_maps(struct session *);
 void paint_map(void);
 void know(coord, coord);
+void know_area(coord, coord, coord, coord);
 void know_section(coord, coord);
 void get_current_section(coord, coord, coord *, coord *);
 void get_current_section_coordinates(coord, coord, coord *, coord *);
@@ -104,6 +122,7 @@ void map_cursor(coord, coord);
 void paint_tile(coord, coord);
 void paint_tile_at_position(coord, coord);
 void change_door(coord, coord, byte);
+BOOL change_tile(coord, coord, byte);
 BOOL is_floor(coord x, coord y);
 void set_knowledge(coord, coord, byte);
 void move_dungeon(void);
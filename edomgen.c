@@ -0,0 +1,723 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * edomgen.c -- offline dungeon generation farm
+ *
+ * Generates levels for a range of dungeon seeds on all cores without SDL,
+ * measures each level and writes the results to a compact file.  Records
+ * are sorted by room count and, within one room count, by descending stair
+ * distance.  The header holds the start of each room count so queries only
+ * touch the matching range.
+ *
+ *   edomgen gen [-o file] [-s first] [-n count] [-d depth] [-j threads]
+ *   edomgen query [-f file] [-r min] [-R max] [-D dist] [-c] [-l limit]
+ *   edomgen show [-s seed] [-d depth]
+ *   edomgen check [-s first] [-n count] [-j threads]
+ *   edomgen stream [-s seed] [-d depth] [-W width] [-H height] [-m chunks]
+ *                  [-n steps]
+ *
+ * Levels are generated the same way as in the game, so rejected layouts are
+ * never recorded.  A seed with no valid layout keeps its last one, flagged
+ * with the validator's fault, and 'query -c' leaves it out.  'check'
+ * validates every level of whole dungeons and reports how often the first
+ * layout had to be rejected.
+ *
+ * 'stream' walks a very large map made of levels laid side by side, held
+ * in a chunk store with only a few chunks resident, and reports how the
+ * store behaved.
+ *
+ * A seed found here is played with "edom <depth> <seed>".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "validate.h"
+#include "chunk.h"
+
+#define FARM_MAGIC    "EDOMFARM"
+#define FARM_VERSION  2
+#define FARM_BLOCK    1024
+#define NO_DISTANCE   0xffff
+
+/* Levels kept for filling chunks of a streamed map */
+#define REGION_CACHE  4
+
+struct farm_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t depth;
+  uint32_t first_seed;
+  uint32_t count;
+
+  /* Records with 'r' rooms are index[r] .. index[r + 1] - 1 */
+  uint32_t index[SECT_NUMBER + 2];
+};
+
+struct farm_record
+{
+  uint32_t seed;
+  uint8_t rooms;
+  uint8_t components;
+  uint16_t corridor;
+  uint16_t stair_dist;
+  uint16_t open;
+
+  /* The validator's verdict, LEVEL_OK unless no valid layout was found */
+  uint8_t fault;
+};
+
+struct farm_job
+{
+  uint32_t first_seed;
+  uint32_t count;
+  byte depth;
+  uint32_t next;
+  struct farm_record *rec;
+
+  /* Results of 'check', 'gen' only counts failed seeds */
+  uint32_t faults[MAX_LEVEL_FAULT];
+  uint32_t failed;
+};
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "usage: edomgen gen [-o file] [-s first] [-n count] [-d depth]"
+          " [-j threads]\n"
+          "       edomgen query [-f file] [-r min_rooms] [-R max_rooms]"
+          " [-D min_dist] [-c] [-l limit]\n"
+          "       edomgen show [-s seed] [-d depth]\n"
+          "       edomgen check [-s first] [-n count] [-j threads]\n"
+          "       edomgen stream [-s seed] [-d depth] [-W width] [-H height]"
+          " [-m chunks] [-n steps]\n");
+  exit(1);
+}
+
+static BOOL passable(byte t)
+{
+  return (t != ROCK && t != LOCKED_DOOR);
+}
+
+/*
+ * Flood fill from one position.  Marks the area with 'mark' and returns
+ * the walking distance to (tx, ty) or NO_DISTANCE.
+ */
+
+static int flood(byte map[MAP_W][MAP_H], uint16 seen[MAP_W][MAP_H],
+                 int x, int y, uint16 mark, int tx, int ty)
+{
+  static __thread int16 qx[MAP_W * MAP_H], qy[MAP_W * MAP_H];
+  static __thread uint16 dist[MAP_W][MAP_H];
+  int head = 0, tail = 0, found = NO_DISTANCE;
+
+  seen[x][y] = mark;
+  dist[x][y] = 0;
+  qx[tail] = x;
+  qy[tail++] = y;
+
+  while (head < tail) {
+
+    x = qx[head];
+    y = qy[head++];
+
+    if (x == tx && y == ty)
+      found = dist[x][y];
+
+#define VISIT(nx, ny)							\
+    if ((nx) >= 0 && (nx) < MAP_W && (ny) >= 0 && (ny) < MAP_H &&	\
+        !seen[nx][ny] && passable(map[nx][ny])) {			\
+      seen[nx][ny] = mark;						\
+      dist[nx][ny] = dist[x][y] + 1;					\
+      qx[tail] = (nx);							\
+      qy[tail++] = (ny);						\
+    }
+
+    VISIT(x - 1, y);
+    VISIT(x + 1, y);
+    VISIT(x, y - 1);
+    VISIT(x, y + 1);
+
+#undef VISIT
+  }
+
+  return found;
+}
+
+static void measure(const struct level *lv, byte depth,
+                    byte map[MAP_W][MAP_H], struct farm_record *r)
+{
+  static __thread uint16 seen[MAP_W][MAP_H];
+  int x, y, sx, sy, in_rooms = 0, open = 0, components = 1;
+  int tx = -1, ty = -1;
+
+  memset(seen, 0, sizeof(seen));
+
+  r->rooms = 0;
+  for (sx = 0; sx < NSECT_W; sx++)
+    for (sy = 0; sy < NSECT_H; sy++)
+      if (lv->s[sx][sy].exists) {
+        r->rooms++;
+        in_rooms += (lv->s[sx][sy].rx2 - lv->s[sx][sy].rx1 - 1) *
+                    (lv->s[sx][sy].ry2 - lv->s[sx][sy].ry1 - 1);
+      }
+
+  if (depth < MAX_DUNGEON_LEVEL - 1) {
+    tx = lv->stxd;
+    ty = lv->styd;
+  }
+
+  /* The area holding the upward stairs comes first */
+  r->stair_dist = flood(map, seen, lv->stxu, lv->styu, 1, tx, ty);
+
+  for (x = 0; x < MAP_W; x++)
+    for (y = 0; y < MAP_H; y++)
+      if (passable(map[x][y])) {
+        open++;
+        if (!seen[x][y])
+          flood(map, seen, x, y, ++components, -1, -1);
+      }
+
+  r->components = components;
+  r->open = open;
+  r->corridor = open - in_rooms;
+}
+
+static void *farm_worker(void *arg)
+{
+  struct farm_job *job = arg;
+  struct level lv;
+  byte map[MAP_W][MAP_H];
+  uint32_t i, first, last, failed = 0;
+
+  for (;;) {
+
+    first = __atomic_fetch_add(&job->next, FARM_BLOCK, __ATOMIC_RELAXED);
+    if (first >= job->count)
+      break;
+
+    last = first + FARM_BLOCK;
+    if (last > job->count)
+      last = job->count;
+
+    for (i = first; i < last; i++) {
+
+      rand_type seed = job->first_seed + i;
+
+      job->rec[i].seed = seed;
+      job->rec[i].fault = LEVEL_OK;
+      if (!generate_level(&lv, seed, job->depth, map)) {
+        job->rec[i].fault = validate_level(&lv, job->depth, map);
+        failed++;
+      }
+
+      measure(&lv, job->depth, map, &job->rec[i]);
+    }
+  }
+
+  __atomic_fetch_add(&job->failed, failed, __ATOMIC_RELAXED);
+
+  return NULL;
+}
+
+static void *check_worker(void *arg)
+{
+  struct farm_job *job = arg;
+  struct level lv;
+  byte map[MAP_W][MAP_H];
+  uint32_t i, first, last, faults[MAX_LEVEL_FAULT], failed = 0;
+  byte depth;
+  int f;
+
+  memset(faults, 0, sizeof(faults));
+
+  for (;;) {
+
+    first = __atomic_fetch_add(&job->next, FARM_BLOCK, __ATOMIC_RELAXED);
+    if (first >= job->count)
+      break;
+
+    last = first + FARM_BLOCK;
+    if (last > job->count)
+      last = job->count;
+
+    for (i = first; i < last; i++)
+      for (depth = 0; depth < MAX_DUNGEON_LEVEL; depth++) {
+
+        /* Validate the first layout, then make sure a valid one exists */
+        seed_rand(level_seed(job->first_seed + i, depth));
+        dig_level(&lv, depth);
+        build_level(&lv, depth, map);
+        faults[validate_level(&lv, depth, map)]++;
+
+        if (!generate_level(&lv, job->first_seed + i, depth, map))
+          failed++;
+      }
+  }
+
+  for (f = 0; f < MAX_LEVEL_FAULT; f++)
+    __atomic_fetch_add(&job->faults[f], faults[f], __ATOMIC_RELAXED);
+  __atomic_fetch_add(&job->failed, failed, __ATOMIC_RELAXED);
+
+  return NULL;
+}
+
+static double run_job(struct farm_job *job, void *(*worker)(void *),
+                      int nthreads)
+{
+  pthread_t *threads;
+  struct timespec t0, t1;
+  int i;
+
+  threads = malloc(sizeof(pthread_t) * nthreads);
+  if (threads == NULL) {
+    fprintf(stderr, "Fatal Error -- Out of memory\n");
+    exit(1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  for (i = 0; i < nthreads; i++)
+    pthread_create(&threads[i], NULL, worker, job);
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  free(threads);
+
+  return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static int compare_records(const void *a, const void *b)
+{
+  const struct farm_record *ra = a, *rb = b;
+
+  if (ra->rooms != rb->rooms)
+    return ra->rooms - rb->rooms;
+
+  if (ra->stair_dist != rb->stair_dist)
+    return (ra->stair_dist == NO_DISTANCE ? -1 :
+            rb->stair_dist == NO_DISTANCE ? 1 :
+            rb->stair_dist - ra->stair_dist);
+
+  return ra->seed < rb->seed ? -1 : ra->seed > rb->seed;
+}
+
+static int farm_generate(int argc, char **argv)
+{
+  struct farm_job job;
+  struct farm_header hdr;
+  const char *out = "farm.dat";
+  int i, c, nthreads;
+  double secs;
+  FILE *fp;
+
+  memset(&job, 0, sizeof(job));
+  job.count = 1000000;
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((c = getopt(argc, argv, "o:s:n:d:j:")) != -1) {
+    switch (c) {
+      case 'o': out = optarg; break;
+      case 's': job.first_seed = strtoul(optarg, NULL, 0); break;
+      case 'n': job.count = strtoul(optarg, NULL, 0); break;
+      case 'd': job.depth = atoi(optarg); break;
+      case 'j': nthreads = atoi(optarg); break;
+      default: usage();
+    }
+  }
+
+  if (job.depth < 0 || job.depth >= MAX_DUNGEON_LEVEL || job.count == 0)
+    usage();
+  if (nthreads < 1)
+    nthreads = 1;
+
+  job.rec = malloc(sizeof(struct farm_record) * job.count);
+  if (job.rec == NULL) {
+    fprintf(stderr, "Fatal Error -- Out of memory\n");
+    return 1;
+  }
+
+  secs = run_job(&job, farm_worker, nthreads);
+
+  qsort(job.rec, job.count, sizeof(struct farm_record), compare_records);
+
+  /* Build the room count index */
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, FARM_MAGIC, sizeof(hdr.magic));
+  hdr.version = FARM_VERSION;
+  hdr.depth = job.depth;
+  hdr.first_seed = job.first_seed;
+  hdr.count = job.count;
+
+  for (i = 0, c = 0; c <= SECT_NUMBER + 1; c++) {
+    while (i < (int) job.count && job.rec[i].rooms < c)
+      i++;
+    hdr.index[c] = i;
+  }
+
+  fp = fopen(out, "wb");
+  if (fp == NULL ||
+      fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+      fwrite(job.rec, sizeof(struct farm_record), job.count, fp) != job.count) {
+    fprintf(stderr, "Fatal Error -- Unable to write %s\n", out);
+    return 1;
+  }
+  fclose(fp);
+
+  fprintf(stderr, "%u levels in %.2f s (%.0f levels/min) on %d threads\n",
+          job.count, secs, job.count / secs * 60.0, nthreads);
+  if (job.failed)
+    fprintf(stderr, "%u seeds without a valid layout\n", job.failed);
+
+  free(job.rec);
+
+  return 0;
+}
+
+static int farm_query(int argc, char **argv)
+{
+  struct farm_header hdr;
+  struct farm_record r;
+  const char *in = "farm.dat";
+  int c, min_rooms = 0, max_rooms = SECT_NUMBER, min_dist = 0;
+  int connected = 0, limit = 20, found = 0, down;
+  uint32_t i;
+  FILE *fp;
+
+  while ((c = getopt(argc, argv, "f:r:R:D:cl:")) != -1) {
+    switch (c) {
+      case 'f': in = optarg; break;
+      case 'r': min_rooms = atoi(optarg); break;
+      case 'R': max_rooms = atoi(optarg); break;
+      case 'D': min_dist = atoi(optarg); break;
+      case 'c': connected = 1; break;
+      case 'l': limit = atoi(optarg); break;
+      default: usage();
+    }
+  }
+
+  if (min_rooms < 0)
+    min_rooms = 0;
+  if (max_rooms > SECT_NUMBER)
+    max_rooms = SECT_NUMBER;
+  if (min_rooms > max_rooms)
+    return 0;
+
+  fp = fopen(in, "rb");
+  if (fp == NULL || fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+      memcmp(hdr.magic, FARM_MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.version != FARM_VERSION) {
+    fprintf(stderr, "Fatal Error -- %s is not a farm file\n", in);
+    return 1;
+  }
+
+  printf("# depth %u, seeds %u..%u\n", hdr.depth, hdr.first_seed,
+         hdr.first_seed + hdr.count - 1);
+  printf("# seed rooms components corridor stair_dist open fault\n");
+
+  /* The bottom level has no stairs down and no stair distance */
+  down = hdr.depth < MAX_DUNGEON_LEVEL - 1;
+
+  for (c = max_rooms; c >= min_rooms && found < limit; c--) {
+
+    fseek(fp, sizeof(hdr) + (long) hdr.index[c] * sizeof(r), SEEK_SET);
+
+    for (i = hdr.index[c]; i < hdr.index[c + 1] && found < limit; i++) {
+
+      if (fread(&r, sizeof(r), 1, fp) != 1)
+        break;
+
+      /* Unreachable stairs sort first, then by falling distance */
+      if (r.stair_dist != NO_DISTANCE && r.stair_dist < min_dist)
+        break;
+      if (r.stair_dist == NO_DISTANCE && down && min_dist)
+        continue;
+      if (connected && r.fault != LEVEL_OK)
+        continue;
+
+      printf("%u %u %u %u %d %u %s\n", r.seed, r.rooms, r.components,
+             r.corridor, r.stair_dist == NO_DISTANCE ? -1 : r.stair_dist,
+             r.open, level_fault_names[r.fault]);
+      found++;
+    }
+  }
+
+  fclose(fp);
+
+  return 0;
+}
+
+static int farm_check(int argc, char **argv)
+{
+  struct farm_job job;
+  int c, nthreads;
+  double secs;
+
+  memset(&job, 0, sizeof(job));
+  job.count = 10000;
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((c = getopt(argc, argv, "s:n:j:")) != -1) {
+    switch (c) {
+      case 's': job.first_seed = strtoul(optarg, NULL, 0); break;
+      case 'n': job.count = strtoul(optarg, NULL, 0); break;
+      case 'j': nthreads = atoi(optarg); break;
+      default: usage();
+    }
+  }
+
+  if (job.count == 0)
+    usage();
+  if (nthreads < 1)
+    nthreads = 1;
+
+  secs = run_job(&job, check_worker, nthreads);
+
+  printf("%u dungeons, %u levels in %.2f s on %d threads\n", job.count,
+         job.count * MAX_DUNGEON_LEVEL, secs, nthreads);
+  for (c = 0; c < MAX_LEVEL_FAULT; c++)
+    printf("%-20s %u\n", level_fault_names[c], job.faults[c]);
+  printf("%-20s %u\n", "no_valid_layout", job.failed);
+
+  return job.failed != 0;
+}
+
+static int farm_show(int argc, char **argv)
+{
+  struct level lv;
+  struct farm_record r;
+  byte map[MAP_W][MAP_H];
+  rand_type seed = 0;
+  byte depth = 0;
+  int c, x, y;
+
+  while ((c = getopt(argc, argv, "s:d:")) != -1) {
+    switch (c) {
+      case 's': seed = strtoul(optarg, NULL, 0); break;
+      case 'd': depth = atoi(optarg); break;
+      default: usage();
+    }
+  }
+
+  if (depth < 0 || depth >= MAX_DUNGEON_LEVEL)
+    usage();
+
+  generate_level(&lv, seed, depth, map);
+  measure(&lv, depth, map, &r);
+
+  for (y = 0; y < MAP_H; y++) {
+    for (x = 0; x < MAP_W; x++)
+      putchar(map[x][y]);
+    putchar('\n');
+  }
+
+  printf("seed %u depth %d: %u rooms, %u components, corridor %u, "
+         "stair distance %d, open %u\n", seed, depth, r.rooms, r.components,
+         r.corridor, r.stair_dist == NO_DISTANCE ? -1 : r.stair_dist, r.open);
+
+  return 0;
+}
+
+/*
+ * A streamed map is a grid of regions, each an ordinary level from its own
+ * seed.  Chunks do not line up with regions, so the last few levels are
+ * kept while the cells of a chunk are filled.
+ */
+
+struct region
+{
+  int rx, ry;
+  byte map[MAP_W][MAP_H];
+};
+
+struct world
+{
+  rand_type seed;
+  byte depth;
+  int w, h, regions_w;
+  int used, next;
+  struct region cache[REGION_CACHE];
+};
+
+static struct region *get_region(struct world *w, int rx, int ry)
+{
+  struct level lv;
+  struct region *r;
+  int i;
+
+  for (i = 0; i < w->used; i++)
+    if (w->cache[i].rx == rx && w->cache[i].ry == ry)
+      return &w->cache[i];
+
+  if (w->used < REGION_CACHE)
+    i = w->used++;
+  else
+    i = w->next++ % REGION_CACHE;
+
+  r = &w->cache[i];
+  r->rx = rx;
+  r->ry = ry;
+  generate_level(&lv, w->seed + ry * w->regions_w + rx, w->depth, r->map);
+
+  return r;
+}
+
+static void world_chunk(void *ctx, int cx, int cy, unsigned char *cells,
+                        unsigned char *gfx)
+{
+  struct world *w = ctx;
+  struct region *r = NULL;
+  int i, j, x, y;
+
+  for (j = 0; j < CHUNK_SIZE; j++)
+    for (i = 0; i < CHUNK_SIZE; i++) {
+
+      x = (cx << CHUNK_SHIFT) + i;
+      y = (cy << CHUNK_SHIFT) + j;
+      if (x >= w->w || y >= w->h) {
+        cells[j * CHUNK_SIZE + i] = ROCK;
+        continue;
+      }
+
+      if (r == NULL || r->rx != x / MAP_W || r->ry != y / MAP_H)
+        r = get_region(w, x / MAP_W, y / MAP_H);
+      cells[j * CHUNK_SIZE + i] = r->map[x % MAP_W][y % MAP_H];
+    }
+}
+
+static int farm_stream(int argc, char **argv)
+{
+  static struct world w;
+  struct chunk_store *s;
+  struct timespec t0, t1;
+  int c, x, y, i, vx, vy, dx = 1, dy = 0, max_resident = 256;
+  long step, steps = 100000, open = 0, lost = 0;
+  int *trail;
+  double secs;
+
+  w.w = w.h = 4096;
+
+  while ((c = getopt(argc, argv, "s:d:W:H:m:n:")) != -1) {
+    switch (c) {
+      case 's': w.seed = strtoul(optarg, NULL, 0); break;
+      case 'd': w.depth = atoi(optarg); break;
+      case 'W': w.w = atoi(optarg); break;
+      case 'H': w.h = atoi(optarg); break;
+      case 'm': max_resident = atoi(optarg); break;
+      case 'n': steps = atol(optarg); break;
+      default: usage();
+    }
+  }
+
+  if (w.depth < 0 || w.depth >= MAX_DUNGEON_LEVEL ||
+      w.w < VMAP_W || w.h < VMAP_H || steps <= 0)
+    usage();
+
+  w.regions_w = (w.w + MAP_W - 1) / MAP_W;
+
+  s = new_chunk_store(w.w, w.h, max_resident, ROCK, world_chunk, &w);
+  trail = malloc(sizeof(int) * 2 * steps);
+  if (s == NULL || trail == NULL) {
+    fprintf(stderr, "Fatal Error -- Out of memory\n");
+    return 1;
+  }
+
+  srand(w.seed);
+  x = w.w / 2;
+  y = w.h / 2;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  for (step = 0; step < steps; step++) {
+
+    /* Wander, and now and then go back to the start */
+    if (step % 64 == 0) {
+      dx = rand() % 3 - 1;
+      dy = rand() % 3 - 1;
+    }
+    if (step % 4096 == 4095) {
+      x = w.w / 2;
+      y = w.h / 2;
+    }
+    x = x + dx < 0 || x + dx >= w.w ? x : x + dx;
+    y = y + dy < 0 || y + dy >= w.h ? y : y + dy;
+
+    /* Look at the screen around the walker, dig and learn its cell */
+    for (vy = y - VMAP_H / 2; vy < y + VMAP_H / 2; vy++)
+      for (vx = x - VMAP_W / 2; vx < x + VMAP_W / 2; vx++)
+        open += chunk_cell(s, vx, vy) != ROCK;
+
+    set_chunk_cell(s, x, y, FLOOR);
+    set_chunk_known(s, x, y, 1);
+    trail[2 * step] = x;
+    trail[2 * step + 1] = y;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  /* Every change must have survived eviction */
+  for (i = 0; i < 2 * steps; i += 2)
+    if (chunk_cell(s, trail[i], trail[i + 1]) != FLOOR ||
+        !chunk_known(s, trail[i], trail[i + 1]))
+      lost++;
+
+  printf("%dx%d map, %d chunks, at most %d resident\n", w.w, w.h,
+         s->cw * s->ch, s->max_resident);
+  printf("%ld steps in %.2f s, %lu lookups (%.1f ns each), %ld open\n",
+         steps, secs, s->lookups, secs * 1e9 / s->lookups, open);
+  printf("misses %lu, generated %lu, spilled %lu, read back %lu, lost %ld\n",
+         s->misses, s->generated, s->spills, s->reloads, lost);
+
+  free(trail);
+  free_chunk_store(s);
+
+  return lost != 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+    usage();
+
+  /* Let getopt see the command as argv[0] */
+  if (strcmp(argv[1], "gen") == 0)
+    return farm_generate(argc - 1, argv + 1);
+  if (strcmp(argv[1], "query") == 0)
+    return farm_query(argc - 1, argv + 1);
+  if (strcmp(argv[1], "show") == 0)
+    return farm_show(argc - 1, argv + 1);
+  if (strcmp(argv[1], "check") == 0)
+    return farm_check(argc - 1, argv + 1);
+  if (strcmp(argv[1], "stream") == 0)
+    return farm_stream(argc - 1, argv + 1);
+
+  usage();
+
+  return 1;
+}
@@ -0,0 +1,202 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * edompack.c -- offline asset pack builder
+ *
+ * Decodes the given sheets once and stores them in one file in the display
+ * format, so the game maps them at startup instead of inflating PNGs.
+ *
+ *   edompack [-o file] image...
+ *
+ * Sheets are looked up by the name given here, which must be the name the
+ * game loads them with.  Color keyed sheets are stored with per pixel
+ * alpha.  Rebuild the pack whenever an image changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SDL.h"
+#include "SDL_image.h"
+
+#include "pack.h"
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: edompack [-o file] image...\n");
+  exit(1);
+}
+
+static Uint32 get_pixel(SDL_Surface *s, int x, int y)
+{
+  Uint8 *p = (Uint8 *) s->pixels + y * s->pitch + x * s->format->BytesPerPixel;
+
+  switch (s->format->BytesPerPixel)
+  {
+    case 1:
+      return *p;
+    case 2:
+      return *(Uint16 *) p;
+    case 3:
+      if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
+        return p[0] << 16 | p[1] << 8 | p[2];
+      return p[0] | p[1] << 8 | p[2] << 16;
+    default:
+      return *(Uint32 *) p;
+  }
+}
+
+/* Convert a decoded sheet to pack pixels, returns the pack flags */
+static uint32_t convert_sheet(SDL_Surface *img, uint32_t *out)
+{
+  Uint32 pixel, key = img->format->colorkey;
+  int keyed = img->flags & SDL_SRCCOLORKEY;
+  int alpha = (img->flags & SDL_SRCALPHA) && img->format->Amask;
+  Uint8 r, g, b, a;
+  int x, y;
+
+  SDL_LockSurface(img);
+
+  for (y = 0; y < img->h; y++)
+    for (x = 0; x < img->w; x++)
+    {
+      pixel = get_pixel(img, x, y);
+      SDL_GetRGBA(pixel, img->format, &r, &g, &b, &a);
+
+      if (keyed && pixel == key)
+        a = 0;
+      else if (!alpha)
+        a = 255;
+
+      *out++ = (uint32_t) a << 24 | r << 16 | g << 8 | b;
+    }
+
+  SDL_UnlockSurface(img);
+
+  return alpha || keyed ? PACK_ALPHA : 0;
+}
+
+static int write_pad(FILE *fp, long to)
+{
+  while (ftell(fp) < to)
+    if (fputc(0, fp) == EOF)
+      return 0;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  const char *out = DEFAULT_PACK;
+  struct pack_header hdr;
+  struct pack_entry *e;
+  SDL_Surface *img;
+  uint32_t *pixels;
+  uint64_t offset;
+  FILE *fp;
+  int c, i, n;
+
+  while ((c = getopt(argc, argv, "o:")) != -1) {
+    switch (c) {
+      case 'o': out = optarg; break;
+      default: usage();
+    }
+  }
+
+  n = argc - optind;
+  if (n < 1)
+    usage();
+
+  e = calloc(n, sizeof(struct pack_entry));
+  if (e == NULL) {
+    fprintf(stderr, "edompack: out of memory\n");
+    return 1;
+  }
+
+  fp = fopen(out, "wb");
+  if (fp == NULL) {
+    perror(out);
+    return 1;
+  }
+
+  /* The index is written last, once every offset is known */
+  offset = sizeof(hdr) + n * sizeof(struct pack_entry);
+  for (i = 0; i < n; i++) {
+    const char *fn = argv[optind + i];
+
+    if (strlen(fn) >= PACK_NAME_LEN) {
+      fprintf(stderr, "edompack: name too long: %s\n", fn);
+      return 1;
+    }
+
+    img = IMG_Load(fn);
+    if (img == NULL) {
+      fprintf(stderr, "edompack: unable to load %s: %s\n", fn, IMG_GetError());
+      return 1;
+    }
+
+    pixels = malloc((size_t) img->w * img->h * 4);
+    if (pixels == NULL) {
+      fprintf(stderr, "edompack: out of memory\n");
+      return 1;
+    }
+
+    offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+    strcpy(e[i].name, fn);
+    e[i].w = img->w;
+    e[i].h = img->h;
+    e[i].pitch = img->w * 4;
+    e[i].flags = convert_sheet(img, pixels);
+    e[i].offset = offset;
+
+    if (!write_pad(fp, offset) ||
+        fwrite(pixels, e[i].pitch, e[i].h, fp) != e[i].h) {
+      perror(out);
+      return 1;
+    }
+
+    offset += (uint64_t) e[i].pitch * e[i].h;
+    printf("%-*s %4ux%-4u %s\n", PACK_NAME_LEN, fn, e[i].w, e[i].h,
+           e[i].flags & PACK_ALPHA ? "alpha" : "opaque");
+
+    free(pixels);
+    SDL_FreeSurface(img);
+  }
+
+  hdr.magic = PACK_MAGIC;
+  hdr.version = PACK_VERSION;
+  hdr.count = n;
+  hdr.reserved = 0;
+
+  if (fseek(fp, 0, SEEK_SET) != 0 ||
+      fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+      fwrite(e, sizeof(struct pack_entry), n, fp) != (size_t) n ||
+      fclose(fp) != 0) {
+    perror(out);
+    return 1;
+  }
+
+  free(e);
+
+  return 0;
+}
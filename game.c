@@ -22,38 +22,44 @@
 
 #include "main.h"
 #include "ctrl.h"
+#include "metrics.h"
+#include "broadcast.h"
 
 
 /*
- * Local variables.
+ * Walk mode state, kept with the session.
  */
 
-BOOL walk_mode;
-BOOL walk_in_room;
-int16 walk_steps;
+#define walk_mode (session->walk.mode)
+#define walk_in_room (session->walk.in_room)
+#define walk_steps (session->walk.steps)
+#define old_cn (session->walk.cn)
+#define old_cw (session->walk.cw)
+#define old_ce (session->walk.ce)
+#define old_cs (session->walk.cs)
 
 
 /*
  * Local prototypes.
  */
 
-void update_screen(coord, coord);
+void update_view(void);
+void update_screen(void);
 void try(byte);
 void descend_level(void);
 void ascend_level(void);
 void open_door(void);
+void dig(void);
 void attack(void);
 void activate_walk_mode(void);
 
 
 /*
- * Event driven input
+ * Commands given by a key press.
  */
 
-static void game_keydown(int key)
+static void game_command(int input)
 {
-  int input = get_input_keydown(key);
-
   if (input & PRESS_ENTER)
     open_door();
 
@@ -65,18 +71,21 @@ static void game_keydown(int key)
 
   if (input & PRESS_REVERT)
     ascend_level();
+
+  if (input & PRESS_LOG)
+    scroll_messages();
+
+  if (input & PRESS_DIG)
+    dig();
 }
 
 
 /*
- * The main function.
+ * Set up the starting level of the current session.
  */
 
-void play(int start_level)
+void start_game(int start_level)
 {
-  coord opx, opy;
-  BOOL quit = 0;
-  
   /*
    * Build the current level.
    *
@@ -90,101 +99,145 @@ void play(int start_level)
   d.visited[0] = TRUE;
   
   /* Initial player position. */
-  place_player(d.stxu[d.dl], d.styu[d.dl]);
+  place_player(d.lv[d.dl].stxu, d.lv[d.dl].styu);
 
   /* Initial panel position. */
   d.psx = d.psy = 0;
+}
 
-  /*
-   * Standard stuff.
-   */
-  
-  do
-  {
-    /* Print all the new things. */
-    update_screen(d.px, d.py);
 
-    /* The message line should be cleared in any case. */
-    clear_messages();
-    
-    /* Memorize the old PC position. */
-    opx = d.px;
-    opy = d.py;
+/*
+ * Advance the current session by one frame.  'held' are the inputs held
+ * down and 'pressed' those pressed since the last frame, both are only
+ * used while the player is idle.  Returns FALSE once the player quits.
+ */
 
-    if (d.pa.act == ATTACK)
+BOOL step_game(int held, int pressed)
+{
+  coord opx, opy;
+
+  /* Learn the surroundings and follow the player. */
+  update_view();
+
+  /* Memorize the old PC position. */
+  opx = d.px;
+  opy = d.py;
+
+  if (d.pa.act == ATTACK)
+  {
+    move_monsters();
+    animate_attack_actor(&d.pa);
+  }
+  else if (d.pa.act == MOVE)
+  {
+    move_monsters();
+    animate_move_actor(&d.pa);
+  }
+  else if (d.pa.act == IDLE)
+  {
+    move_monsters();
+    game_command(pressed);
+
+    if (held & PRESS_LEFT)
     {
-      move_monsters();
-      animate_attack_actor(&d.pa);
+      set_dir_actor(&d.pa, LEFT);
+      if (is_open(d.px - 1, d.py) &&
+          !is_monster_at(d.px - 1, d.py))
+        move_player(LEFT);
     }
-    else if (d.pa.act == MOVE)
+    else if (held & PRESS_RIGHT)
     {
-      move_monsters();
-      animate_move_actor(&d.pa);
+      set_dir_actor(&d.pa, RIGHT);
+      if (is_open(d.px + 1, d.py) &&
+          !is_monster_at(d.px + 1, d.py))
+        move_player(RIGHT);
     }
-    else if (d.pa.act == IDLE)
+    else if (held & PRESS_UP)
     {
-      move_monsters();
-      SDL_Event event;
+      set_dir_actor(&d.pa, UP);
+      if (is_open(d.px, d.py - 1) &&
+          !is_monster_at(d.px, d.py - 1))
+        move_player(UP);
+    }
+    else if (held & PRESS_DOWN)
+    {
+      set_dir_actor(&d.pa, DOWN);
+      if (is_open(d.px, d.py + 1) &&
+          !is_monster_at(d.px, d.py + 1))
+        move_player(DOWN);
+    }
+  }
 
-      while (SDL_PollEvent(&event))
-      {
-        if (event.type == SDL_QUIT)
-          quit = TRUE;
+  d.opx = opx;
+  d.opy = opy;
 
-        if (event.type == SDL_KEYDOWN)
-          game_keydown(event.key.keysym.sym);
-      }
+  /* Quitting or leaving the dungeon ends the game. */
+  return !(held & PRESS_ESC) && d.dl >= 0;
+}
 
-      int input = get_input();
 
-      if (input & PRESS_ESC)
-        quit = TRUE;
+/*
+ * The main function.
+ */
 
-      if (input & PRESS_LEFT)
-      {
-        set_dir_actor(&d.pa, LEFT);
-        if (is_open(d.px - 1, d.py) &&
-            !is_monster_at(d.px - 1, d.py))
-          move_player(LEFT);
-      }
-      else if (input & PRESS_RIGHT)
-      {
-        set_dir_actor(&d.pa, RIGHT);
-        if (is_open(d.px + 1, d.py) &&
-            !is_monster_at(d.px + 1, d.py))
-          move_player(RIGHT);
-      }
-      else if (input & PRESS_UP)
-      {
-        set_dir_actor(&d.pa, UP);
-        if (is_open(d.px, d.py - 1) &&
-            !is_monster_at(d.px, d.py - 1))
-          move_player(UP);
-      }
-      else if (input & PRESS_DOWN)
-      {
-        set_dir_actor(&d.pa, DOWN);
-        if (is_open(d.px, d.py + 1) &&
-            !is_monster_at(d.px, d.py + 1))
-          move_player(DOWN);
-      }
+void play(int start_level)
+{
+  Uint32 now, next;
+  int held, pressed;
+  BOOL running = TRUE;
+
+  start_game(start_level);
+  next = SDL_GetTicks();
+
+  while (running)
+  {
+    /* Queue the input that arrived. */
+    pump_input();
+
+    /* Wait for the next tick. */
+    now = SDL_GetTicks();
+    if ((Sint32) (next - now) > 0)
+    {
+      SDL_Delay(next - now);
+      continue;
     }
 
-    d.opx = opx;
-    d.opy = opy;
+    /* Do not catch up on a long stall. */
+    if (now - next > MAX_CATCH_UP * TICK_MS)
+      next = now - MAX_CATCH_UP * TICK_MS;
+
+    /* The game advances at a fixed rate, whatever the frame rate. */
+    while (running && (Sint32) (now - next) >= 0)
+    {
+      /* Input is only taken while the player waits for it. */
+      held = pressed = 0;
+      if (d.pa.act == IDLE)
+        take_input(next, &held, &pressed);
+
+      running = step_game(held, pressed);
+
+      /* Spectators see every tick of a game still running. */
+      if (running)
+        broadcast_view();
+
+      next += TICK_MS;
+    }
+
+    /* Print all the new things. */
+    if (running)
+      update_screen();
   }
-  while (quit == FALSE);
 }
 
 
 /*
- * Update the screen based upon the current player position.  Panel scrolling
- * is also handled in this function.
+ * Make the surroundings of the player known and move the view.  Panel
+ * scrolling is also handled in this function.
  */
 
-void update_screen(coord x, coord y)
+void update_view(void)
 {
-  coord sx, sy, px, py;
+  coord sx, sy;
 
   /* Find the current general section. */
   get_current_section_coordinates(d.px, d.py, &sx, &sy);
@@ -212,9 +265,7 @@ void update_screen(coord x, coord y)
 #endif
 
   /* Make the immediate surroundings known. */
-  for (px = x - 1; px <= x + 1; px++)
-    for (py = y - 1; py <= y + 1; py++)
-      know(px, py);
+  know_area(d.px - 1, d.py - 1, d.px + 1, d.py + 1);
 
   /* Check whether the PC is in a room or not. */
   get_current_section(d.px, d.py, &sx, &sy);
@@ -224,14 +275,41 @@ void update_screen(coord x, coord y)
     know_section(sx, sy);
 
   move_dungeon();
+}
+
+
+/*
+ * Draw the current session.
+ */
+
+void update_screen(void)
+{
+  unsigned long blits;
+  Uint32 ticks;
+  static unsigned long last_blits = 0;
+  static Uint32 last_ticks = 0;
 
   draw_dungeon();
   draw_monsters();
   draw_actor(&d.pa);
 
+  draw_messages();
   draw_player_status();
+  draw_hud();
 
+  flush_sprites();
   flip();
+
+  /* Frame statistics. */
+  /* Band workers count their own blits. */
+  blits = get_metric_total(MC_BLITS);
+  ticks = SDL_GetTicks();
+  METRIC_INC(MC_FRAMES);
+  sample_metric(MH_BLITS_PER_FRAME, blits - last_blits);
+  if (last_ticks)
+    sample_metric(MH_FRAME_MS, ticks - last_ticks);
+  last_blits = blits;
+  last_ticks = ticks;
 }
 
 
@@ -251,7 +329,6 @@ void try(byte dir)
 {
   coord sx1, sy1, sx2, sy2;
   byte cn, cw, ce, cs;
-  static byte old_cn, old_cw, old_ce, old_cs;
   
   get_current_section(d.px, d.py, &sx1, &sy1);
   
@@ -454,7 +531,7 @@ void descend_level(void)
   else
   {
     modify_dungeon_level(+1);
-    place_player(d.stxu[d.dl], d.styu[d.dl]);
+    place_player(d.lv[d.dl].stxu, d.lv[d.dl].styu);
   }
 }
 
@@ -473,7 +550,7 @@ void ascend_level(void)
     if (d.dl)
     {
       modify_dungeon_level(-1);
-      place_player(d.stxu[d.dl], d.styu[d.dl]);
+      place_player(d.lv[d.dl].stxu, d.lv[d.dl].styu);
     }
     else
       /* Leave the dungeon. */
@@ -522,6 +599,33 @@ void open_door(void)
 
 
 
+/*
+ * Tunnel through rock.
+ */
+
+void dig(void)
+{
+  coord tx, ty;
+
+  /* Dig where the player faces. */
+  get_target(d.px, d.py, &tx, &ty);
+
+  /* Command aborted? */
+  if (tx == -1 || ty == -1)
+    return;
+
+  if (tile_at(tx, ty) != ROCK)
+    message("There is nothing to dig there.");
+  else if (tx < 1 || ty < 1 || tx >= MAP_W - 1 || ty >= MAP_H - 1)
+    message("This rock is too hard to dig.");
+  else if (change_tile(tx, ty, FLOOR))
+    you("dig through the rock.");
+  else
+    message("The rock resists your efforts.");
+}
+
+
+
 void attack(void)
 {
   coord tx, ty;
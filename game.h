@@ -36,6 +36,8 @@
  */
 
 void play(int start_level);
+void start_game(int start_level);
+BOOL step_game(int held, int pressed);
 void modify_dungeon_level(byte);
 void redraw(void);
 
@@ -0,0 +1,173 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * hud.c -- retained head-up display
+ *
+ * The message and status lines are kept on one sprite that is composited
+ * with a single blit per frame.  Boxes and labels are drawn once, fields
+ * remember their contents and only a field that changed is drawn again.
+ * Positions are in pixels relative to the display and fields should lie
+ * on the font grid of a box so their background can be restored.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sprite.h"
+#include "draw_text.h"
+#include "hud.h"
+
+typedef struct {
+  int x, y, len;
+
+  /* Last contents, 'value' is only valid for numeric fields */
+  int numeric;
+  long value;
+  char text[HUD_TEXT_MAX];
+} HUD_FIELD;
+
+static SPRITE *hud;
+static FONT *hud_font;
+static int hud_x, hud_y;
+static HUD_FIELD fields[HUD_MAX_FIELDS];
+static int num_fields;
+
+int init_hud(int x, int y, int w, int h, FONT *fnt)
+{
+  hud = new_sprite(w, h, fnt->img);
+  if (hud == NULL) {
+    fprintf(stderr, "Fatal Error -- Unable to create head-up display\n");
+    return 0;
+  }
+
+  hud_font = fnt;
+  hud_x = x;
+  hud_y = y;
+  num_fields = 0;
+
+  return 1;
+}
+
+void free_hud(void)
+{
+  if (hud != NULL)
+    free_sprite(hud);
+  hud = NULL;
+}
+
+void hud_box(int x, int y, int w, int h)
+{
+  set_sprite_target(hud, 0);
+  draw_text_background(x, y, w, h, hud_font);
+  set_sprite_target(NULL, 0);
+}
+
+static void draw_glyphs(int x, int y, const char *str, int len)
+{
+  int i, fw;
+
+  fw = hud_font->img->w;
+
+  set_sprite_target(hud, 1);
+  for (i = 0; i < len && str[i]; i++)
+    draw_sprite(x + i * fw, y, str[i] - ' ', hud_font->img,
+                0, 0, hud->w, hud->h);
+  set_sprite_target(NULL, 0);
+}
+
+void hud_label(int x, int y, const char *str)
+{
+  draw_glyphs(x, y, str, strlen(str));
+}
+
+int hud_field(int x, int y, int len)
+{
+  HUD_FIELD *f;
+
+  if (num_fields >= HUD_MAX_FIELDS)
+    return -1;
+
+  f = &fields[num_fields];
+  f->x = x;
+  f->y = y;
+  f->len = len < HUD_TEXT_MAX ? len : HUD_TEXT_MAX - 1;
+  f->numeric = 0;
+  f->text[0] = '\0';
+
+  return num_fields++;
+}
+
+static void draw_field(HUD_FIELD *f)
+{
+  int i, fw;
+
+  fw = hud_font->img->w;
+
+  /* Restore the box background under the field */
+  set_sprite_target(hud, 0);
+  for (i = 0; i < f->len; i++)
+    draw_sprite(f->x + i * fw, f->y, TEXTBOX_BACKGROUND_SPRITE, hud_font->img,
+                0, 0, hud->w, hud->h);
+  set_sprite_target(NULL, 0);
+
+  draw_glyphs(f->x, f->y, f->text, f->len);
+}
+
+void hud_text(int id, const char *str)
+{
+  HUD_FIELD *f;
+
+  if (id < 0 || id >= num_fields)
+    return;
+
+  f = &fields[id];
+  if (!f->numeric && strncmp(f->text, str, f->len) == 0)
+    return;
+
+  f->numeric = 0;
+  strncpy(f->text, str, f->len);
+  f->text[f->len] = '\0';
+  draw_field(f);
+}
+
+void hud_number(int id, long value)
+{
+  HUD_FIELD *f;
+
+  if (id < 0 || id >= num_fields)
+    return;
+
+  f = &fields[id];
+  if (f->numeric && f->value == value)
+    return;
+
+  f->numeric = 1;
+  f->value = value;
+  snprintf(f->text, f->len + 1, "%*ld", f->len, value);
+  draw_field(f);
+}
+
+void draw_hud(void)
+{
+  if (hud != NULL)
+    queue_sprite(LAYER_PANEL, hud_x, hud_y, 0, hud,
+                 0, 0, window_width, window_height);
+}
@@ -0,0 +1,40 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * hud.h -- Header for retained head-up display
+ */
+
+#ifndef _hud_h
+#define _hud_h
+
+#define HUD_MAX_FIELDS	32
+#define HUD_TEXT_MAX	128
+
+int init_hud(int x, int y, int w, int h, FONT *fnt);
+void free_hud(void);
+void hud_box(int x, int y, int w, int h);
+void hud_label(int x, int y, const char *str);
+int hud_field(int x, int y, int len);
+void hud_text(int id, const char *str);
+void hud_number(int id, long value);
+void draw_hud(void);
+
+#endif
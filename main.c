@@ -34,13 +34,29 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include "SDL.h"
 #include "sprite.h"
+#include "blit.h"
+#include "pack.h"
+#include "metrics.h"
+#include "ctrl.h"
 #include "main.h"
+#include "session.h"
+#include "net.h"
+#include "broadcast.h"
 
 
 static SDL_Surface *screen;
 
+/* The game is drawn into frame at the logical size, then scaled up. */
+static SDL_Surface *frame;
+static int logical_w = SCREEN_W;
+static int logical_h = SCREEN_H;
+static int scale = 1;
+
 int screen_width = 0;
 int screen_height = 0;
 
@@ -62,6 +78,7 @@ struct anim_info common_anim =
  */
 
 int init(void);
+void usage(void);
 
 /*
  * Local functions.
@@ -80,7 +97,7 @@ int init(void)
   atexit(SDL_Quit);
 
   /* Initialize screen, setup gfx mode */
-  screen = SDL_SetVideoMode(SCREEN_W, SCREEN_H, 32,
+  screen = SDL_SetVideoMode(logical_w * scale, logical_h * scale, 32,
                             SDL_HWSURFACE|SDL_DOUBLEBUF);
   if (screen == NULL)
   {
@@ -89,10 +106,34 @@ int init(void)
     return 0;
   }
 
-  set_sprite_context(screen, SCREEN_W, SCREEN_H);
+  /* Scaled windows get a logical framebuffer in the screen format */
+  frame = screen;
+  if (scale > 1)
+  {
+    if (screen->format->BytesPerPixel != 4)
+    {
+      fprintf(stderr, "Fatal Error -- Scaling needs a 32 bit screen\n");
+      return 0;
+    }
+
+    frame = SDL_CreateRGBSurface(SDL_SWSURFACE, logical_w, logical_h, 32,
+                                 screen->format->Rmask, screen->format->Gmask,
+                                 screen->format->Bmask, 0);
+    if (frame == NULL)
+    {
+      fprintf(stderr, "Fatal Error -- Unable to create framebuffer: %s\n",
+              SDL_GetError());
+      return 0;
+    }
+  }
+
+  set_sprite_context(frame, logical_w, logical_h);
 
-  screen_width = SCREEN_W;
-  screen_height = SCREEN_H - MSG_H - STATUS_H;
+  /* Sheets missing from the pack are loaded from their images */
+  open_pack(DEFAULT_PACK);
+
+  screen_width = logical_w;
+  screen_height = logical_h - MSG_H - STATUS_H;
 
   font = load_font("fntdag.png", FNT_W, FNT_H);
   if (font == NULL)
@@ -101,14 +142,37 @@ int init(void)
     return 0;
   }
 
+  if (!init_hud(0, screen_height, screen_width, MSG_H + STATUS_H, font))
+    return 0;
+
   return 1;
 }
 
 void flip(void)
 {
+  /* Present the logical frame in one pass, straight into the screen */
+  if (frame != screen && (!SDL_MUSTLOCK(screen) || SDL_LockSurface(screen) >= 0))
+  {
+    blit_scale32(screen->pixels, screen->pitch, frame->pixels, frame->pitch,
+                 logical_w, logical_h, scale);
+
+    if (SDL_MUSTLOCK(screen))
+      SDL_UnlockSurface(screen);
+  }
+
   SDL_Flip(screen);
 }
 
+void usage(void)
+{
+  fprintf(stderr, "usage: edom [-g WxH] [-x scale] [-B name] [level [seed]]\n"
+                  "       edom -S sessions [-j threads] [-t ticks]"
+                  " [-L socket] [level [seed]]\n"
+                  "       edom -C socket [-g WxH] [-x scale]\n"
+                  "       edom -V name [-g WxH] [-x scale]\n");
+  exit(1);
+}
+
 /*
  * The main function.
  */
@@ -116,6 +180,11 @@ void flip(void)
 int main(int argc, char **argv)
 {
   int start_level = 0;
+  int nsessions = 0, nthreads, ticks = 1000;
+  rand_type seed;
+  char *interval, *listen_path = NULL, *client_path = NULL;
+  char *broadcast_name = NULL, *viewer_name = NULL;
+  int c;
 
   /* Print startup message. */
   printf("Current dungeon size: %ld.\n"
@@ -126,17 +195,98 @@ int main(int argc, char **argv)
 	 , (long int) sizeof(struct section));
   printf("\n");
   
-  if (argc > 1)
-    start_level = atoi(argv[1]);
-  
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  /* Logical screen size and integer window scale, or a server. */
+  while ((c = getopt(argc, argv, "g:x:S:j:t:L:C:B:V:")) != -1) {
+    switch (c) {
+      case 'g':
+        if (sscanf(optarg, "%dx%d", &logical_w, &logical_h) != 2)
+          usage();
+        break;
+      case 'x': scale = atoi(optarg); break;
+      case 'S': nsessions = atoi(optarg); break;
+      case 'j': nthreads = atoi(optarg); break;
+      case 't': ticks = atoi(optarg); break;
+      case 'L': listen_path = optarg; break;
+      case 'C': client_path = optarg; break;
+      case 'B': broadcast_name = optarg; break;
+      case 'V': viewer_name = optarg; break;
+      default: usage();
+    }
+  }
+
+  if (logical_w < MIN_SCREEN_W || logical_h < MIN_SCREEN_H ||
+      scale < 1 || scale > MAX_SCALE)
+  {
+    fprintf(stderr, "Screen must be at least %dx%d, scale 1 to %d.\n",
+            MIN_SCREEN_W, MIN_SCREEN_H, MAX_SCALE);
+    return 1;
+  }
+
+  if (argc > optind)
+    start_level = atoi(argv[optind]);
+
+  /* The dungeon seed may be given to replay a dungeon. */
+  if (argc > optind + 1)
+    seed = strtoul(argv[optind + 1], NULL, 0);
+  else
+    seed = (rand_type) time(NULL);
+  printf("Dungeon seed: %u.\n", seed);
+
+  /* Run many games without a display, session i from seed + i. */
+  if (nsessions > 0)
+  {
+    if (nthreads < 1 || ticks < 0)
+      usage();
+    return run_server(nsessions, nthreads, ticks, seed, start_level,
+                      listen_path);
+  }
+
+  /* The one game on screen. */
+  enter_session(new_session(TRUE));
+  if (session == NULL)
+  {
+    fprintf(stderr, "Fatal Error -- Unable to create session\n");
+    return 1;
+  }
+  d.seed = seed;
+
   if (!init())
     return 1;
 
+  /* Keys may be bound again from a file. */
+  if (getenv("EDOM_KEYS") != NULL && !load_bindings(getenv("EDOM_KEYS")))
+    return 1;
+
+  /* Export runtime metrics if requested. */
+  interval = getenv("EDOM_METRICS_INTERVAL");
+  if (init_metrics(getenv("EDOM_METRICS"), interval ? atoi(interval) : 0))
+    atexit(stop_metrics);
+
   /* Initialize everything. */
   init_rand();
   init_player();
   init_monsters();
   init_dungeon();
+  init_messages();
+  init_status();
+
+  /* Play a session of a server. */
+  if (client_path != NULL)
+    return run_client(client_path);
+
+  /* Watch a game on another display. */
+  if (viewer_name != NULL)
+    return run_viewer(viewer_name);
+
+  /* Let others watch this one. */
+  if (broadcast_name != NULL)
+  {
+    if (!open_broadcast(broadcast_name))
+      return 1;
+    atexit(close_broadcast);
+  }
   
   /* Play the game. */
   play(start_level);
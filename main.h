@@ -27,8 +27,10 @@
  * Includes.
  */
 
+#include <stdint.h>
 #include "config.h"
 #include "dungeon.h"
+#include "dig.h"
 #include "error.h"
 #include "game.h"
 #include "misc.h"
@@ -36,34 +38,12 @@
 #include "player.h"
 #include "actor.h"
 #include "draw_text.h"
+#include "hud.h"
 #include "sysdep.h"
+#include "map.h"
 
 
 
-/*
- * One section of a level: each dungeon map consists of NSECT_W * NSECT_H
- * sections (see config.g).  A section either contains one room with up
- * to four doors or a tunnel intersection.
- *
- * NOTE: The use of a sectioning approach prevents things like digging, etc.
- */
-
-struct section
-{
-  /* Room available? */
-  BOOL exists;
-
-  /* Room coordinates. */
-  coord rx1, rx2, ry1, ry2;
-
-  /* Door positions. */
-  coord dx[4], dy[4];
-
-  /* Door types. */
-  byte dt[4];
-};
-
-
 /*
  * QHack uses one large structure for the complete dungeon.  There are
  * no pointers or other fancy stuff involved since this game should be
@@ -79,14 +59,11 @@ struct dungeon_complex
   /* The current level number. */
   byte dl;
 
-  /* NSECT_W * NSECT_H sections for each level. */
-  struct section s[MAX_DUNGEON_LEVEL][NSECT_W][NSECT_H];
+  /* The random seed all levels are generated from. */
+  rand_type seed;
 
-  /* Coordinates for stairways. */
-  coord stxu[MAX_DUNGEON_LEVEL];
-  coord styu[MAX_DUNGEON_LEVEL];
-  coord stxd[MAX_DUNGEON_LEVEL - 1];
-  coord styd[MAX_DUNGEON_LEVEL - 1];
+  /* Section descriptions and stairways for each level. */
+  struct level lv[MAX_DUNGEON_LEVEL];
 
   /* Player coordinates. */
   coord px, py;
@@ -94,11 +71,8 @@ struct dungeon_complex
   /* Last player coordinates. */
   coord opx, opy;
 
-  /* Tile map coordinates */
-  int16 map_x, map_y;
-
-  /* The knowledge map. */
-  byte known[MAX_DUNGEON_LEVEL][MAP_BIT_W][MAP_H];
+  /* Changes made to each level since it was generated. */
+  struct level_delta delta[MAX_DUNGEON_LEVEL];
 
   /* The panel positions. */
   coord psx, psy;
@@ -114,8 +88,102 @@ struct dungeon_complex
 };
 
 
-/* The global dungeon structure. */
-struct dungeon_complex d;
+/* The state of walk mode. */
+struct walk_state
+{
+  BOOL mode, in_room;
+  int16 steps;
+
+  /* Obstacles around the player at the last step. */
+  byte cn, cw, ce, cs;
+};
+
+
+/* Maximum length of one message. */
+#define MESSAGE_LEN 80
+
+/* One entry in the message log. */
+struct log_entry
+{
+  /* The message text. */
+  char text[MESSAGE_LEN];
+
+  /* How often the message was repeated. */
+  int count;
+
+  /* When the message was last given (in milliseconds). */
+  Uint32 time;
+};
+
+/* The message log is a ring buffer, 'head' is the next free entry. */
+struct message_log
+{
+  struct log_entry e[MESSAGE_LOG_SIZE];
+  int head, count;
+
+  /* Scrollback position (0 for the newest message) and when it was set. */
+  int view;
+  Uint32 view_time;
+
+  /* Is the newest message still displayed? */
+  BOOL live;
+
+  /* Must the message line be drawn again? */
+  BOOL dirty;
+
+  /* Messages given so far, repeats included. */
+  int serial;
+};
+
+
+/*
+ * Everything that belongs to one game.  A process may run many sessions
+ * (see session.c) but a thread works on one session at a time, which is
+ * reached through 'session'.
+ */
+
+struct session
+{
+  /* The dungeon and its monsters. */
+  struct dungeon_complex dungeon;
+  struct monster_struct monsters;
+
+  /*
+   * The map and knowledge of each level visited (see dungeon.c) and the
+   * monster index map of the current level.
+   */
+  struct chunk_store *levels[MAX_DUNGEON_LEVEL];
+  byte midx[MAP_W][MAP_H];
+  int start_tile;
+
+  /* The total rarity for monsters on the current level. */
+  uint32 total_rarity;
+
+  struct camera camera;
+  struct message_log log;
+  struct walk_state walk;
+
+  /* Must the status line be drawn again? */
+  BOOL status_dirty;
+
+  /* Only the session on screen has sprites and a tile map. */
+  BOOL render;
+  Map *tile_map;
+
+  /* The random number state while the session is not running. */
+  rand_type rand_state;
+
+  /* Server sessions are played by a simple bot, or by a client. */
+  uint32_t bot;
+  int bot_held;
+  struct client *client;
+} __attribute__((aligned(64)));
+
+/* The session run by the current thread. */
+extern __thread struct session *session;
+
+/* The dungeon of the current session. */
+#define d (session->dungeon)
 
 int screen_width;
 int screen_height;
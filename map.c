@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "map.h"
 
 static void clear_map_tiles(Map *map)
@@ -34,38 +35,54 @@ static void clear_map_tiles(Map *map)
 
     map->tiles[i].index = i;
     map->tiles[i].type = 0;
-    map->tiles[i].animated = 0;
+    map->tiles[i].animated = ANIM_NONE;
     map->tiles[i].start_index = map->tiles[i].end_index = 0;
     map->tiles[i].counter = map->tiles[i].treshold = 0;
+    map->tiles[i].dir = 1;
 
   }
+
+  map->num_anims = 0;
 }
 
 Map* new_map(int tw, int th, int num_tiles, int w, int h)
 {
   Map *map;
 
-  map = (Map *) malloc( sizeof(Map) );
+  map = (Map *) calloc(1, sizeof(Map));
   if (map == NULL)
     return NULL;
 
-  map->tiles = (Tile *) malloc( sizeof(Tile) * num_tiles);
-  if (map->tiles == NULL) {
-
-    free(map);
-    return NULL;
-
-  }
-
   map->tw = tw;
   map->th = th;
   map->num_tiles = num_tiles;
   map->w = w;
   map->h = h;
   map->size = w * h;
-  map->dat = (int *) malloc( sizeof(map->dat[0]) * map->size);
+
+  if (num_tiles <= 0x100)
+    map->cell_size = 1;
+  else if (num_tiles <= 0x10000)
+    map->cell_size = 2;
+  else
+    map->cell_size = sizeof(int);
+
+  map->tiles = (Tile *) malloc( sizeof(Tile) * num_tiles);
+  map->anims = (int *) malloc( sizeof(int) * num_tiles);
+  map->changed = (unsigned char *) calloc(num_tiles, 1);
+  map->dat = malloc(map->cell_size * map->size);
+  map->dirty_list = (int *) malloc( sizeof(int) * map->size);
+  map->dirty = (unsigned char *) calloc(map->size, 1);
+  if (map->tiles == NULL || map->anims == NULL || map->changed == NULL ||
+      map->dat == NULL || map->dirty_list == NULL || map->dirty == NULL) {
+
+    free_map(map);
+    return NULL;
+
+  }
 
   clear_map_tiles(map);
+  map->all_dirty = 1;
 
   return map;
 }
@@ -74,6 +91,10 @@ void free_map(Map *m)
 {
   free(m->dat);
   free(m->tiles);
+  free(m->anims);
+  free(m->changed);
+  free(m->dirty_list);
+  free(m->dirty);
   free(m);
 }
 
@@ -81,33 +102,121 @@ void clear_map(Map *map, int tile_num)
 {
   int i;
 
-  for (i = 0; i < map->size; i++)
-    map->dat[i] = tile_num;
+  if (map->cell_size == 1)
+    memset(map->dat, tile_num, map->size);
+  else
+    for (i = 0; i < map->size; i++)
+      putcell_map(map, i, tile_num);
+
+  map->all_dirty = 1;
+}
+
+void check_map(Map *m, int x, int y, const char *file, int line)
+{
+  if (x < 0 || x >= m->w || y < 0 || y >= m->h) {
+    fprintf(stderr, "%s:%d: map position %d,%d outside %dx%d\n",
+            file, line, x, y, m->w, m->h);
+    abort();
+  }
 }
 
 void puttile_map(Map *m,int x,int y,int t)
 {
-  m->dat[x+y*m->w]=t;
+  CHECK_MAP(m, x, y);
+  if (getcell_map(m, x+y*m->w) == t)
+    return;
+
+  putcell_map(m, x+y*m->w, t);
+  dirty_map(m, x, y);
 }
 
 unsigned int gettile_map(Map *m,int x,int y)
 {
-  return(m->dat[x+y*m->w]);
+  CHECK_MAP(m, x, y);
+  return(getcell_map(m, x+y*m->w));
 }
 
 unsigned int gettile_type_map(Map *m,int x,int y)
 {
-  return(m->tiles[(int)(m->dat[x+y*m->w])].type);
+  CHECK_MAP(m, x, y);
+  return(m->tiles[getcell_map(m, x+y*m->w)].type);
 }
 
 unsigned int getblock_index_map(Map *m,int x,int y)
 {
-  return(m->tiles[(int)(m->dat[x+y*m->w])].index);
+  CHECK_MAP(m, x, y);
+  return(m->tiles[getcell_map(m, x+y*m->w)].index);
 }
 
 unsigned int getblock_type_map(Map *m,int x,int y)
 {
-  return(m->tiles[(int)(m->dat[x+y*m->w])].type);
+  CHECK_MAP(m, x, y);
+  return(m->tiles[getcell_map(m, x+y*m->w)].type);
+}
+
+/* Read n cells from x,y to the right */
+void getrow_map(Map *m, int x, int y, int n, int *out)
+{
+  int i, start;
+
+  if (n <= 0)
+    return;
+  CHECK_MAP(m, x, y);
+  CHECK_MAP(m, x + n - 1, y);
+
+  start = x + y * m->w;
+  for (i = 0; i < n; i++)
+    out[i] = getcell_map(m, start + i);
+}
+
+/* Write n cells from x,y to the right, only changed cells are dirty */
+void putrow_map(Map *m, int x, int y, int n, const int *in)
+{
+  int i, start;
+
+  if (n <= 0)
+    return;
+  CHECK_MAP(m, x, y);
+  CHECK_MAP(m, x + n - 1, y);
+
+  start = x + y * m->w;
+  for (i = 0; i < n; i++) {
+    if (getcell_map(m, start + i) == in[i])
+      continue;
+    putcell_map(m, start + i, in[i]);
+    dirty_map(m, x + i, y);
+  }
+}
+
+/* Copy a w x h block of cells between maps, or within one map if the
+   blocks do not overlap */
+void copy_rect_map(Map *dst, int dx, int dy,
+                   Map *src, int sx, int sy, int w, int h)
+{
+  int y, x, s, d;
+
+  if (w <= 0 || h <= 0)
+    return;
+  CHECK_MAP(src, sx, sy);
+  CHECK_MAP(src, sx + w - 1, sy + h - 1);
+  CHECK_MAP(dst, dx, dy);
+  CHECK_MAP(dst, dx + w - 1, dy + h - 1);
+
+  for (y = 0; y < h; y++) {
+    s = sx + (sy + y) * src->w;
+    d = dx + (dy + y) * dst->w;
+
+    if (src->cell_size == dst->cell_size) {
+      memcpy((char *) dst->dat + d * dst->cell_size,
+             (char *) src->dat + s * src->cell_size, w * src->cell_size);
+      continue;
+    }
+
+    for (x = 0; x < w; x++)
+      putcell_map(dst, d + x, getcell_map(src, s + x));
+  }
+
+  dst->all_dirty = 1;
 }
 
 void get_tile_size_map(Map *m, int *w, int *h)
@@ -122,48 +231,132 @@ void get_screen_size_map(Map *m, int *w, int *h)
   *h = m->h * m->th;
 }
 
-void update_animations_map(Map *m)
+/* A cell must be drawn again */
+void dirty_map(Map *m, int x, int y)
+{
+  int i = x + y * m->w;
+
+  if (m->all_dirty || m->dirty[i])
+    return;
+
+  m->dirty[i] = 1;
+  m->dirty_list[m->num_dirty++] = i;
+}
+
+/* Everything was drawn */
+void clean_map(Map *m)
 {
-  static int dir = 1;
   int i;
 
-  for(i=0;i<m->num_tiles;i++)
-  {
-    switch(m->tiles[i].animated)
-    {
-      case 0 :
-      break;
+  for (i = 0; i < m->num_dirty; i++)
+    m->dirty[m->dirty_list[i]] = 0;
 
-      case 1 :
-      if (++m->tiles[i].counter < m->tiles[i].treshold)
-        break;
-      m->tiles[i].counter = 0;
+  m->num_dirty = 0;
+  m->all_dirty = 0;
+}
 
-      m->tiles[i].index++;
+/* Animate tile t through start..end, one frame every ms milliseconds */
+void set_animation_map(Map *m, int t, int kind, int start, int end, int ms)
+{
+  Tile *tile;
+  int i;
 
-      if(m->tiles[i].index<m->tiles[i].start_index)
-        m->tiles[i].index=m->tiles[i].end_index;
+  if (t < 0 || t >= m->num_tiles)
+    return;
 
-      else if(m->tiles[i].index>m->tiles[i].end_index)
-	m->tiles[i].index=m->tiles[i].start_index;
+  tile = &m->tiles[t];
+  tile->animated = kind;
+  tile->start_index = start;
+  tile->end_index = end;
+  tile->index = kind == ANIM_NONE ? t : start;
+  tile->counter = 0;
+  tile->treshold = ms > 0 ? ms : 1;
+  tile->dir = 1;
 
+  for (i = 0; i < m->num_anims; i++)
+    if (m->anims[i] == t)
       break;
 
-      case 2 :
-      if (++m->tiles[i].counter < m->tiles[i].treshold)
-        break;
-      m->tiles[i].counter = 0;
+  if (kind == ANIM_NONE) {
+    if (i < m->num_anims)
+      m->anims[i] = m->anims[--m->num_anims];
+  }
+  else if (i == m->num_anims)
+    m->anims[m->num_anims++] = t;
+
+  m->all_dirty = 1;
+}
 
-      if(m->tiles[i].index<=m->tiles[i].start_index)
-        dir=1;
+static int step_animation(Tile *tile)
+{
+  int index = tile->index;
 
-      else if(m->tiles[i].index>=m->tiles[i].end_index)
-	dir=-1;
+  switch (tile->animated) {
 
-      m->tiles[i].index+=dir;
+    case ANIM_LOOP :
+    if (++index > tile->end_index || index < tile->start_index)
+      index = tile->start_index;
+    break;
 
+    case ANIM_PINGPONG :
+    if (tile->start_index == tile->end_index)
       break;
-    }
+    if (index + tile->dir > tile->end_index)
+      tile->dir = -1;
+    else if (index + tile->dir < tile->start_index)
+      tile->dir = 1;
+    index += tile->dir;
+    break;
+
   }
+
+  return index;
 }
 
+/*
+ * Advance the animated tiles by ms milliseconds and mark the cells from
+ * x0,y0 up to but excluding x1,y1 that show a tile with a new frame.
+ * Cells out of view pick up the frame when they are drawn.  Returns the
+ * number of tiles that changed frame.
+ */
+
+int update_animations_map(Map *m, int ms, int x0, int y0, int x1, int y1)
+{
+  Tile *tile;
+  int i, x, y, num_changed = 0;
+
+  for (i = 0; i < m->num_anims; i++) {
+
+    tile = &m->tiles[m->anims[i]];
+    tile->counter += ms;
+    if (tile->counter < tile->treshold)
+      continue;
+
+    /* Catch up on frames a slow frame missed */
+    while (tile->counter >= tile->treshold) {
+      tile->counter -= tile->treshold;
+      tile->index = step_animation(tile);
+    }
+
+    m->changed[m->anims[i]] = 1;
+    num_changed++;
+  }
+
+  if (num_changed == 0)
+    return 0;
+
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > m->w) x1 = m->w;
+  if (y1 > m->h) y1 = m->h;
+
+  for (y = y0; y < y1; y++)
+    for (x = x0; x < x1; x++)
+      if (m->changed[getcell_map(m, x + y * m->w)])
+        dirty_map(m, x, y);
+
+  for (i = 0; i < m->num_anims; i++)
+    m->changed[m->anims[i]] = 0;
+
+  return num_changed;
+}
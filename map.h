@@ -26,20 +26,42 @@
 #ifndef _map_h
 #define _map_h
 
+/* Kinds of tile animation */
+#define ANIM_NONE	0
+#define ANIM_LOOP	1
+#define ANIM_PINGPONG	2
+
 typedef struct	{
   int index;
   int type;
   int animated;
   int start_index,end_index;
+
+  /* Milliseconds since the last frame and per frame, ping-pong direction */
   int counter,treshold;
+  int dir;
 } Tile;
 
 typedef struct	{
   int  tw,th;
   int w,h;
   int num_tiles,size;
-  int  *dat;
+
+  /* Cells are 1, 2 or 4 bytes, the smallest that holds every tile */
+  int cell_size;
+  void *dat;
   Tile *tiles;
+
+  /* Ids of the animated tiles, and those that changed frame */
+  int num_anims;
+  int *anims;
+  unsigned char *changed;
+
+  /* Cells to draw again, everything when 'all_dirty' is set */
+  int num_dirty;
+  int *dirty_list;
+  unsigned char *dirty;
+  int all_dirty;
 } Map;
 
 typedef struct
@@ -49,17 +71,57 @@ typedef struct
   int index;
 } Object;
 
+/*
+ * Positions are checked unless NDEBUG is defined, a bad access is fatal.
+ */
+
+#ifdef NDEBUG
+#define CHECK_MAP(m,x,y)
+#else
+#define CHECK_MAP(m,x,y) check_map(m, x, y, __FILE__, __LINE__)
+#endif
+
+extern void check_map(Map *m, int x, int y, const char *file, int line);
+
+/* Tile number of cell i, x + y * w */
+static inline int getcell_map(const Map *m, int i)
+{
+  switch (m->cell_size) {
+    case 1 : return ((unsigned char *) m->dat)[i];
+    case 2 : return ((unsigned short *) m->dat)[i];
+    default : return ((int *) m->dat)[i];
+  }
+}
+
+static inline void putcell_map(Map *m, int i, int t)
+{
+  switch (m->cell_size) {
+    case 1 : ((unsigned char *) m->dat)[i] = t; break;
+    case 2 : ((unsigned short *) m->dat)[i] = t; break;
+    default : ((int *) m->dat)[i] = t; break;
+  }
+}
+
 extern Map* new_map(int tw, int th, int num_tiles, int w, int h);
 extern void free_map(Map *m);
 extern void clear_map(Map *m, int tile_num);
 extern void puttile_map(Map *m,int x,int y,int t);
 extern unsigned int gettile_map(Map *m,int x,int y);
+extern void getrow_map(Map *m, int x, int y, int n, int *out);
+extern void putrow_map(Map *m, int x, int y, int n, const int *in);
+extern void copy_rect_map(Map *dst, int dx, int dy,
+                          Map *src, int sx, int sy, int w, int h);
 extern unsigned int gettile_type_map(Map *m,int x,int y);
 extern unsigned int getblock_index_map(Map *m,int x,int y);
 extern unsigned int getblock_type_map(Map *m,int x,int y);
 extern void get_tile_size_map(Map *m, int *w, int *h);
 extern void get_screen_size_map(Map *m, int *w, int *h);
-extern void update_animations_map(Map *m);
+extern void set_animation_map(Map *m, int t, int kind,
+                              int start, int end, int ms);
+extern int update_animations_map(Map *m, int ms, int x0, int y0,
+                                 int x1, int y1);
+extern void dirty_map(Map *m, int x, int y);
+extern void clean_map(Map *m);
 
 #endif
 
@@ -0,0 +1,296 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * metrics.c -- runtime counters and histograms
+ *
+ * Snapshots are written as plain "name value" lines followed by an empty
+ * line.  The destination is either a file, which is replaced atomically on
+ * every snapshot, or a UNIX domain stream socket given as "unix:/path".
+ *
+ * Histogram bucket b is named <histogram>_lt_<2^b>, except the last one:
+ * it also holds every larger value and is named <histogram>_ge_<2^(b-1)>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+__thread struct metric_block *metric_local;
+
+static struct metric_block blocks[METRIC_THREADS];
+static int num_blocks;
+
+static const char *counter_names[MAX_METRIC_COUNTER] =
+{
+  "frames",
+  "blits",
+  "tiles_revealed",
+  "level_builds",
+  "sprite_loads",
+  "monster_ai",
+  "rand_calls",
+  "span_pixels",
+  "map_tiles"
+};
+
+static const char *histogram_names[MAX_METRIC_HISTOGRAM] =
+{
+  "blits_per_frame",
+  "frame_ms"
+};
+
+static char path[108];
+static int use_socket;
+static int sock = -1;
+static int interval;
+static int running;
+static pthread_t sampler;
+
+struct metric_block *attach_metrics(void)
+{
+  int i;
+
+  /* Threads beyond the pool share the last block and may lose counts */
+  i = __atomic_fetch_add(&num_blocks, 1, __ATOMIC_RELAXED);
+  if (i >= METRIC_THREADS)
+    i = METRIC_THREADS - 1;
+
+  metric_local = &blocks[i];
+
+  return metric_local;
+}
+
+unsigned long get_metric(enum metric_counter id)
+{
+  if (metric_local == NULL)
+    return 0;
+
+  return metric_local->c[id];
+}
+
+/* A counter summed over all threads, for counts that workers help with */
+unsigned long get_metric_total(enum metric_counter id)
+{
+  unsigned long sum = 0;
+  int i, n;
+
+  n = __atomic_load_n(&num_blocks, __ATOMIC_RELAXED);
+  if (n > METRIC_THREADS)
+    n = METRIC_THREADS;
+
+  for (i = 0; i < n; i++)
+    sum += __atomic_load_n(&blocks[i].c[id], __ATOMIC_RELAXED);
+
+  return sum;
+}
+
+void sample_metric(enum metric_histogram id, unsigned long value)
+{
+#ifndef NO_METRICS
+  struct metric_block *mb = metric_local;
+  int b = 0;
+
+  if (mb == NULL)
+    mb = attach_metrics();
+
+  /* Bucket b holds values below 2^b, the last one everything above */
+  while (value && b < METRIC_BUCKETS - 1) {
+    value >>= 1;
+    b++;
+  }
+
+  __atomic_store_n(&mb->h[id][b], mb->h[id][b] + 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static void collect_metrics(struct metric_block *sum)
+{
+  int i, j, k, n;
+
+  memset(sum, 0, sizeof(struct metric_block));
+
+  n = __atomic_load_n(&num_blocks, __ATOMIC_RELAXED);
+  if (n > METRIC_THREADS)
+    n = METRIC_THREADS;
+
+  for (i = 0; i < n; i++) {
+
+    for (j = 0; j < MAX_METRIC_COUNTER; j++)
+      sum->c[j] += __atomic_load_n(&blocks[i].c[j], __ATOMIC_RELAXED);
+
+    for (j = 0; j < MAX_METRIC_HISTOGRAM; j++)
+      for (k = 0; k < METRIC_BUCKETS; k++)
+        sum->h[j][k] += __atomic_load_n(&blocks[i].h[j][k],
+                                        __ATOMIC_RELAXED);
+  }
+}
+
+static int format_metrics(char *buf, int size)
+{
+  struct metric_block sum;
+  struct timespec ts;
+  int i, j, len;
+
+  collect_metrics(&sum);
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  len = snprintf(buf, size, "time_ms %ld\n",
+                 (long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+
+  for (i = 0; i < MAX_METRIC_COUNTER && len < size; i++)
+    len += snprintf(buf + len, size - len, "%s %lu\n",
+                    counter_names[i], sum.c[i]);
+
+  for (i = 0; i < MAX_METRIC_HISTOGRAM && len < size; i++)
+    for (j = 0; j < METRIC_BUCKETS && len < size; j++)
+      if (j < METRIC_BUCKETS - 1)
+        len += snprintf(buf + len, size - len, "%s_lt_%lu %lu\n",
+                        histogram_names[i], 1UL << j, sum.h[i][j]);
+      else
+        len += snprintf(buf + len, size - len, "%s_ge_%lu %lu\n",
+                        histogram_names[i], 1UL << (j - 1), sum.h[i][j]);
+
+  if (len < size)
+    len += snprintf(buf + len, size - len, "\n");
+
+  return len < size ? len : size - 1;
+}
+
+static int open_socket(void)
+{
+  struct sockaddr_un addr;
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+    return 0;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    close(sock);
+    sock = -1;
+    return 0;
+  }
+
+  return 1;
+}
+
+static void write_metrics(void)
+{
+  char buf[4096], tmp[sizeof(path) + 4];
+  FILE *fp;
+  int len;
+
+  len = format_metrics(buf, sizeof(buf));
+
+  if (use_socket) {
+
+    /* The scraper may come and go, reconnect on the next snapshot */
+    if (sock < 0 && !open_socket())
+      return;
+
+    if (send(sock, buf, len, MSG_NOSIGNAL) != len) {
+      close(sock);
+      sock = -1;
+    }
+  }
+  else {
+
+    /* Replace the file so readers never see a partial snapshot */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL)
+      return;
+
+    fwrite(buf, 1, len, fp);
+    fclose(fp);
+    rename(tmp, path);
+  }
+}
+
+static void *sampler_main(void *arg)
+{
+  struct timespec ts;
+
+  ts.tv_sec = interval / 1000;
+  ts.tv_nsec = (interval % 1000) * 1000000L;
+
+  while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+    nanosleep(&ts, NULL);
+    write_metrics();
+  }
+
+  return NULL;
+}
+
+int init_metrics(const char *dest, int interval_ms)
+{
+  if (dest == NULL || *dest == '\0')
+    return 0;
+
+  if (strncmp(dest, "unix:", 5) == 0) {
+    use_socket = 1;
+    dest += 5;
+  }
+
+  if (strlen(dest) >= sizeof(path) - 1) {
+    fprintf(stderr, "Error -- Metrics path too long: %s\n", dest);
+    return 0;
+  }
+  strcpy(path, dest);
+
+  interval = interval_ms > 0 ? interval_ms : 1000;
+  running = 1;
+
+  if (pthread_create(&sampler, NULL, sampler_main, NULL) != 0) {
+    fprintf(stderr, "Error -- Unable to start metrics sampler\n");
+    running = 0;
+    return 0;
+  }
+
+  return 1;
+}
+
+void stop_metrics(void)
+{
+  if (!running)
+    return;
+
+  __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+  pthread_join(sampler, NULL);
+
+  /* Final snapshot so short runs are not lost */
+  write_metrics();
+
+  if (sock >= 0) {
+    close(sock);
+    sock = -1;
+  }
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * metrics.h -- runtime counters and histograms
+ * header for metrics.c
+ */
+
+#ifndef _metrics_h
+#define _metrics_h
+
+/* Counters bumped by the instrumented modules */
+enum metric_counter
+{
+  MC_FRAMES,
+  MC_BLITS,
+  MC_TILES_REVEALED,
+  MC_LEVEL_BUILDS,
+  MC_SPRITE_LOADS,
+  MC_MONSTER_AI,
+  MC_RAND_CALLS,
+  MC_SPAN_PIXELS,
+  MC_MAP_TILES,
+  MAX_METRIC_COUNTER
+};
+
+/* Histograms with power of two buckets */
+enum metric_histogram
+{
+  MH_BLITS_PER_FRAME,
+  MH_FRAME_MS,
+  MAX_METRIC_HISTOGRAM
+};
+
+#define METRIC_BUCKETS 16
+
+/* Maximum number of threads with a private counter block */
+#define METRIC_THREADS 64
+
+/*
+ * Each thread bumps its own block so the hot path is a plain load and
+ * store.  The relaxed atomic store only keeps the sampler thread from
+ * reading torn values.
+ */
+
+struct metric_block
+{
+  unsigned long c[MAX_METRIC_COUNTER];
+  unsigned long h[MAX_METRIC_HISTOGRAM][METRIC_BUCKETS];
+} __attribute__((aligned(64)));
+
+extern __thread struct metric_block *metric_local;
+
+#ifdef NO_METRICS
+
+#define METRIC_ADD(id, n)
+#define METRIC_INC(id)
+
+#else
+
+#define METRIC_ADD(id, n)						\
+  do {									\
+    struct metric_block *mb_ = metric_local;				\
+    if (mb_ == NULL)							\
+      mb_ = attach_metrics();						\
+    __atomic_store_n(&mb_->c[id], mb_->c[id] + (n), __ATOMIC_RELAXED);	\
+  } while (0)
+
+#define METRIC_INC(id) METRIC_ADD(id, 1)
+
+#endif
+
+extern struct metric_block *attach_metrics(void);
+extern unsigned long get_metric(enum metric_counter id);
+extern unsigned long get_metric_total(enum metric_counter id);
+extern void sample_metric(enum metric_histogram id, unsigned long value);
+extern int init_metrics(const char *dest, int interval_ms);
+extern void stop_metrics(void);
+
+#endif
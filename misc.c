@@ -34,11 +34,11 @@
  * Local variables.
  */
 
-/* Is the message buffer currently used? */
-static BOOL mbuffer_full = FALSE;
+/* The message log of the current session. */
+#define mlog (session->log)
 
-/* What's the current x position in the message buffer? */
-static byte mbuffer_x = 0;
+/* The message line on the head-up display. */
+static int message_field = -1;
 
 
 
@@ -47,6 +47,7 @@ static byte mbuffer_x = 0;
  */
 
 void more(void);
+static struct log_entry *log_entry(int);
 
 
 
@@ -54,35 +55,153 @@ void more(void);
  * Functions.
  */
 
+/*
+ * Create the message line on the head-up display.
+ */
+
+void init_messages(void)
+{
+  hud_box(0, 0, screen_width - 2 * FNT_W, FNT_H);
+  message_field = hud_field(FNT_W, FNT_H, (screen_width - 2 * FNT_W) / FNT_W);
+}
+
+
+
+/*
+ * Get a log entry, counting backwards from the newest message.
+ */
+
+static struct log_entry *log_entry(int age)
+{
+  return &mlog.e[(mlog.head - 1 - age + MESSAGE_LOG_SIZE) % MESSAGE_LOG_SIZE];
+}
+
+
+
+/*
+ * Add a message to the message log.
+ *
+ * Repeated messages are coalesced into one entry with a counter.
+ */
+
+static void log_message(char *text)
+{
+  struct log_entry *e;
+
+  if (mlog.count && strcmp(log_entry(0)->text, text) == 0)
+    e = log_entry(0);
+  else
+  {
+    e = &mlog.e[mlog.head];
+    strncpy(e->text, text, MESSAGE_LEN - 1);
+    e->text[MESSAGE_LEN - 1] = '\0';
+    e->count = 0;
+
+    mlog.head = (mlog.head + 1) % MESSAGE_LOG_SIZE;
+    if (mlog.count < MESSAGE_LOG_SIZE)
+      mlog.count++;
+  }
+
+  e->count++;
+  e->time = SDL_GetTicks();
+  mlog.serial++;
+
+  /* New messages end the scrollback. */
+  mlog.view = 0;
+  mlog.live = TRUE;
+  mlog.dirty = TRUE;
+}
+
+
+
 /*
  * Display a message in the message line.
  *
- * The color will be reset to light gray and the message buffer will be
- * cleared if it was full.
+ * The message is added to the message log and drawn with the next frame.
  */
 
 void message(char *fmt, ...)
 {
   va_list vl;
-  static char buffer[1000];
+  char buffer[MESSAGE_LEN];
 
   /* Evaluate the format string. */
   va_start(vl, fmt);
-  vsprintf(buffer, fmt, vl);
+  vsnprintf(buffer, sizeof(buffer), fmt, vl);
   va_end(vl);
 
-#if 0
-  /* Clear the message buffer if necessary. */
-  if (mbuffer_full)
-    more();
-#endif
+  log_message(buffer);
+}
 
-  /* Display the message. */
-  draw_fixed_text(0, screen_height, screen_width - 2 * FNT_W, buffer, font);
 
-  /* Note the new message in the buffer. */
-  mbuffer_full = TRUE;
-  mbuffer_x = strlen(buffer) + 1;
+
+/*
+ * Step back through the message log, one message per call.  After the
+ * oldest message the newest one is shown again.
+ */
+
+void scroll_messages(void)
+{
+  if (!mlog.count)
+    return;
+
+  mlog.view = mlog.view % mlog.count + 1;
+  mlog.view_time = SDL_GetTicks();
+  mlog.dirty = TRUE;
+}
+
+
+
+/*
+ * Draw the message line from the message log.
+ *
+ * This is called once per frame.  The line is only drawn again if the
+ * message log changed or a message expired.
+ */
+
+void draw_messages(void)
+{
+  char line[MESSAGE_LEN + 16];
+  struct log_entry *e;
+  Uint32 now = SDL_GetTicks();
+
+  /* Return from the scrollback after a while. */
+  if (mlog.view && now - mlog.view_time > MESSAGE_TIMEOUT)
+  {
+    mlog.view = 0;
+    mlog.dirty = TRUE;
+  }
+
+  /* Messages expire. */
+  if (!mlog.view && mlog.live && now - log_entry(0)->time > MESSAGE_TIMEOUT)
+  {
+    mlog.live = FALSE;
+    mlog.dirty = TRUE;
+  }
+
+  if (!mlog.dirty)
+    return;
+
+  line[0] = '\0';
+  if (mlog.view)
+  {
+    e = log_entry(mlog.view - 1);
+    if (e->count > 1)
+      snprintf(line, sizeof(line), "%d: %s x%d", mlog.view, e->text, e->count);
+    else
+      snprintf(line, sizeof(line), "%d: %s", mlog.view, e->text);
+  }
+  else if (mlog.live)
+  {
+    e = log_entry(0);
+    if (e->count > 1)
+      snprintf(line, sizeof(line), "%s x%d", e->text, e->count);
+    else
+      snprintf(line, sizeof(line), "%s", e->text);
+  }
+
+  hud_text(message_field, line);
+  mlog.dirty = FALSE;
 }
 
 
@@ -94,10 +213,10 @@ void message(char *fmt, ...)
 void you(char *fmt, ...)
 {
   va_list vl;
-  static char buffer[1000];
+  char buffer[MESSAGE_LEN];
 
   va_start(vl, fmt);
-  vsprintf(buffer, fmt, vl);
+  vsnprintf(buffer, sizeof(buffer), fmt, vl);
   va_end(vl);
   
   message("You %s", buffer);
@@ -128,12 +247,9 @@ void more(void)
 
 void clear_messages(void)
 {
-#if 0
-  cursor(0, 0);
-  clear_to_eol();
-  mbuffer_full = FALSE;
-  mbuffer_x = 0;
-#endif
+  mlog.view = 0;
+  mlog.live = FALSE;
+  mlog.dirty = TRUE;
 }
 
 
@@ -40,9 +40,12 @@ uint32 imax(int32, int32);
 uint32 imin(int32, int32);
 char *string(char *, ...);
 
+void init_messages(void);
 void you(char *, ...);
 void message(char *, ...);
 void clear_messages(void);
+void scroll_messages(void);
+void draw_messages(void);
 void get_target(coord, coord, coord *, coord *);
 
 #endif
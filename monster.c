@@ -31,6 +31,7 @@
  */
 
 #include "main.h"
+#include "metrics.h"
 
 
 /*
@@ -40,18 +41,15 @@
 /* The total number of monsters. */
 #define MAX_MONSTER 4
 
-/*
- * Global variables.
- */
-
-struct monster_struct m;
-
-
 /*
  * Local variables.
  */
 
 
+/* The monsters and the monster index map of the current session. */
+#define mon (session->monsters)
+#define mindex (session->midx)
+
 /* The complete monster list for the game. */
 struct monster_def md[MAX_MONSTER] =
 {
@@ -61,14 +59,6 @@ struct monster_def md[MAX_MONSTER] =
   {"samurai.png", 31, 32, "samurai", 18, "2d3", 1, +1, "1d4", RARE}
 };
 
-/* The dynamic index map for one monster level. */
-static byte midx[MAP_W][MAP_H];
-
-/* The total rarity for monsters; dependent on the current level. */
-static uint32 total_rarity;
-
-
-
 /*
  * Local prototypes.
  */
@@ -95,24 +85,24 @@ void init_monsters(void)
   for (i = 0; i < MAX_DUNGEON_LEVEL; i++)
   {
     /* The first empty monster slot. */
-    m.eidx[i] = 0;
+    mon.eidx[i] = 0;
 
     /* Initially all slots are empty. */
     for (j = 0; j < MONSTERS_PER_LEVEL - 1; j++)
     {
-      m.m[i][j].used = FALSE;
-      m.m[i][j].midx = j + 1;
+      mon.m[i][j].used = FALSE;
+      mon.m[i][j].midx = j + 1;
     }
 
     /* The last one points to 'no more slots'. */
-    m.m[i][MONSTERS_PER_LEVEL - 1].midx = -1;
-    m.m[i][MONSTERS_PER_LEVEL - 1].used = FALSE;
+    mon.m[i][MONSTERS_PER_LEVEL - 1].midx = -1;
+    mon.m[i][MONSTERS_PER_LEVEL - 1].used = FALSE;
   }
 
   /* Initialize the monster index map as 'empty'. */
   for (i = 0; i < MAP_W; i++)
     for (j = 0; j < MAP_H; j++)
-      midx[i][j] = -1;
+      mindex[i][j] = -1;
 }
 
 
@@ -128,12 +118,12 @@ void build_monster_map(void)
   /* Initialize the monster index map as 'empty'. */
   for (x = 0; x < MAP_W; x++)
     for (y = 0; y < MAP_H; y++)
-      midx[x][y] = -1;
+      mindex[x][y] = -1;
 
   /* Setup all monster indices. */
   for (x = 0; x < MONSTERS_PER_LEVEL; x++)
-    if (m.m[d.dl][x].used)
-      midx[m.m[d.dl][x].x][m.m[d.dl][x].y] = x;
+    if (mon.m[d.dl][x].used)
+      mindex[mon.m[d.dl][x].x][mon.m[d.dl][x].y] = x;
 }
 
 
@@ -144,12 +134,12 @@ void build_monster_map(void)
 
 void create_population(void)
 {
-  byte m;
+  byte i;
 
   /* Initialize the basic monster data. */
   initialize_monsters();
 
-  for (m = 0; m < INITIAL_MONSTER_NUMBER; m++)
+  for (i = 0; i < INITIAL_MONSTER_NUMBER; i++)
   {
     byte midx;
 
@@ -167,6 +157,25 @@ void create_population(void)
 
 
 
+/*
+ * Start loading the sheets of every monster that may appear on a given
+ * dungeon level, so entering it does not wait for them.
+ */
+
+void prefetch_monsters(byte depth)
+{
+  byte i;
+
+  if (depth < 0 || depth >= MAX_DUNGEON_LEVEL)
+    return;
+
+  for (i = 0; i < imin(MAX_MONSTER, ((depth << 1) + 4)); i++)
+    prefetch_sprite(md[i].filename, md[i].w, md[i].h,
+                    SPRITE_ASYNC | SPRITE_PACKED);
+}
+
+
+
 /*
  * Return the maximum monster number for the current dungeon level.
  *
@@ -225,10 +234,10 @@ void initialize_monsters(void)
 {
   byte i;
   
-  total_rarity = 0;
+  session->total_rarity = 0;
 
   for (i = 0; i < max_monster(); i++)
-    total_rarity += monster_rarity(i);
+    session->total_rarity += monster_rarity(i);
 }
 
 
@@ -243,7 +252,7 @@ byte random_monster_type(void)
   int32 roll;
   byte i;
 
-  roll = rand_long(total_rarity) + 1;
+  roll = rand_long(session->total_rarity) + 1;
   i = 0;
 
   while (roll > monster_rarity(i))
@@ -257,6 +266,21 @@ byte random_monster_type(void)
 
 
 
+/*
+ * Set up the actor of a monster type.  Returns FALSE for unknown types.
+ */
+
+BOOL init_monster_actor(struct actor *a, byte type)
+{
+  if (type < 0 || type >= MAX_MONSTER)
+    return FALSE;
+
+  init_actor(a, md[type].filename, md[type].w, md[type].h, &common_anim);
+  return TRUE;
+}
+
+
+
 /*
  * Create a new monster in a given slot.
  */
@@ -268,24 +292,22 @@ void create_monster_in(byte midx)
   type = random_monster_type();
 
   /* Initialize actor based on monster type */
-  init_actor(&m.m[d.dl][midx].a,
-             md[type].filename, md[type].w, md[type].h,
-             &common_anim);
+  init_monster_actor(&mon.m[d.dl][midx].a, type);
 
   /* Adjust the 'empty' index. */
-  if (m.eidx[d.dl] == midx)
-    m.eidx[d.dl] = m.m[d.dl][midx].midx; 
+  if (mon.eidx[d.dl] == midx)
+    mon.eidx[d.dl] = mon.m[d.dl][midx].midx; 
 
   /* Create the actual monster. */
-  m.m[d.dl][midx].used = TRUE;
-  m.m[d.dl][midx].midx = type;
-  get_monster_coordinates(&m.m[d.dl][midx].x, &m.m[d.dl][midx].y);
-  m.m[d.dl][midx].hp = m.m[d.dl][midx].max_hp = mhits(m.m[d.dl][midx].midx);
-  m.m[d.dl][midx].state = ASLEEP;
+  mon.m[d.dl][midx].used = TRUE;
+  mon.m[d.dl][midx].midx = type;
+  get_monster_coordinates(&mon.m[d.dl][midx].x, &mon.m[d.dl][midx].y);
+  mon.m[d.dl][midx].hp = mon.m[d.dl][midx].max_hp = mhits(mon.m[d.dl][midx].midx);
+  mon.m[d.dl][midx].state = ASLEEP;
 
   /* Fill in in actor field */
-  m.m[d.dl][midx].a.x = m.m[d.dl][midx].x * TILE_WIDTH;
-  m.m[d.dl][midx].a.y = m.m[d.dl][midx].y * TILE_HEIGHT;
+  mon.m[d.dl][midx].a.x = mon.m[d.dl][midx].x * TILE_WIDTH;
+  mon.m[d.dl][midx].a.y = mon.m[d.dl][midx].y * TILE_HEIGHT;
 }
 
 
@@ -307,7 +329,7 @@ void get_monster_coordinates(coord *x, coord *y)
   }
   while (tile_at(*x, *y) != FLOOR ||
 	 los(*x, *y) ||
-	 midx[*x][*y] != -1);
+	 mindex[*x][*y] != -1);
 }
 
 
@@ -329,7 +351,7 @@ int16 mhits(byte midx)
 
 byte get_monster_index(void)
 {
-  return m.eidx[d.dl];
+  return mon.eidx[d.dl];
 }
 
 
@@ -365,11 +387,11 @@ BOOL los(coord x, coord y)
 struct monster *get_monster_at(coord x, coord y)
 {
   /* Paranoia. */
-  if (midx[x][y] == -1)
+  if (mindex[x][y] == -1)
     die("No monster to retrieve");
 
   /* Return the requested monster. */
-  return &m.m[d.dl][midx[x][y]];
+  return &mon.m[d.dl][mindex[x][y]];
 }
 
 
@@ -398,9 +420,9 @@ void attack_monster_at(coord x, coord y)
 
 void remove_monster_at(coord x, coord y)
 {
-  m.m[d.dl][midx[x][y]].midx = -1;
-  m.m[d.dl][midx[x][y]].used = FALSE;
-  midx[x][y] = -1;
+  mon.m[d.dl][mindex[x][y]].midx = -1;
+  mon.m[d.dl][mindex[x][y]].used = FALSE;
+  mindex[x][y] = -1;
 }
 
 
@@ -411,42 +433,42 @@ void remove_monster_at(coord x, coord y)
 
 BOOL is_monster_at(coord x, coord y)
 {
-  return (midx[x][y] != -1);
+  return (mindex[x][y] != -1);
 }
 
 
 
-static BOOL is_clear(struct monster *m, enum facing dir)
+static BOOL is_clear(struct monster *mi, enum facing dir)
 {
   BOOL result = FALSE;
 
   switch(dir)
   {
     case DOWN:
-      if (is_floor(m->x, m->y + 1) &&
-          !is_monster_at(m->x, m->y + 1) &&
-          !(m->x == d.px && m->y + 1 == d.py))
+      if (is_floor(mi->x, mi->y + 1) &&
+          !is_monster_at(mi->x, mi->y + 1) &&
+          !(mi->x == d.px && mi->y + 1 == d.py))
         result = TRUE;
       break;
 
     case LEFT:
-      if (is_floor(m->x - 1, m->y) &&
-          !is_monster_at(m->x - 1, m->y) &&
-          !(m->x - 1 == d.px && m->y == d.py))
+      if (is_floor(mi->x - 1, mi->y) &&
+          !is_monster_at(mi->x - 1, mi->y) &&
+          !(mi->x - 1 == d.px && mi->y == d.py))
         result = TRUE;
       break;
 
     case RIGHT:
-        if (is_floor(m->x + 1, m->y) &&
-            !is_monster_at(m->x + 1, m->y) &&
-            !(m->x + 1 == d.px && m->y == d.py))
+        if (is_floor(mi->x + 1, mi->y) &&
+            !is_monster_at(mi->x + 1, mi->y) &&
+            !(mi->x + 1 == d.px && mi->y == d.py))
         result = TRUE;
       break;
 
     case UP:
-      if (is_floor(m->x, m->y - 1) &&
-          !is_monster_at(m->x, m->y - 1) &&
-          !(m->x == d.px && m->y - 1 == d.py))
+      if (is_floor(mi->x, mi->y - 1) &&
+          !is_monster_at(mi->x, mi->y - 1) &&
+          !(mi->x == d.px && mi->y - 1 == d.py))
         result = TRUE;
       break;
   }
@@ -454,27 +476,27 @@ static BOOL is_clear(struct monster *m, enum facing dir)
   return result;
 }
 
-void move_monster(struct monster *m, enum facing dir)
+void move_monster(struct monster *mi, enum facing dir)
 {
   byte i;
 
-  if (m->a.act == IDLE)
+  if (mi->a.act == IDLE)
   {
-    set_dir_actor(&m->a, dir);
-    move_actor(&m->a, dir);
+    set_dir_actor(&mi->a, dir);
+    move_actor(&mi->a, dir);
 
     /* Store mondest index in slot at current position */
-    i = midx[m->x][m->y];
+    i = mindex[mi->x][mi->y];
 
     /* Clear slot */
-    midx[m->x][m->y] = -1;
+    mindex[mi->x][mi->y] = -1;
 
     /* Update monster position */
-    m->x += m->a.dx;
-    m->y += m->a.dy;
+    mi->x += mi->a.dx;
+    mi->y += mi->a.dy;
 
     /* Set index in slot at new position */
-    midx[m->x][m->y] = i;
+    mindex[mi->x][mi->y] = i;
   }
 }
 
@@ -485,15 +507,19 @@ void move_monster(struct monster *m, enum facing dir)
 
 void move_monsters(void)
 {
+  struct tile_rect r;
   coord x, y;
-  int sx = d.map_x / TILE_WIDTH;
-  int sy = d.map_y / TILE_HEIGHT;
 
-  for (y = 0; y < screen_height / TILE_HEIGHT; y++)
-    for (x = 0; x < screen_width / TILE_WIDTH; x++)
-      if (is_monster_at(sx + x, sy + y) && los(sx + x, sy + y))
+  /* Only monsters in view act */
+  visible_tiles(&session->camera, 0, &r);
+
+  for (y = r.y0; y < r.y1; y++)
+    for (x = r.x0; x < r.x1; x++)
+      if (is_monster_at(x, y) && los(x, y))
       {
-        struct monster *mi = get_monster_at(sx + x, sy + y);
+        struct monster *mi = get_monster_at(x, y);
+
+        METRIC_INC(MC_MONSTER_AI);
 
         if (mi->a.act == COUNTER)
         {
@@ -549,16 +575,18 @@ void move_monsters(void)
 
 void draw_monsters(void)
 {
+  struct tile_rect r;
   coord x, y;
-  int sx = d.map_x / TILE_WIDTH;
-  int sy = d.map_y / TILE_HEIGHT;
 
-  for (y = 0; y < screen_height / TILE_HEIGHT; y++)
-    for (x = 0; x < screen_width / TILE_WIDTH; x++)
-      if (is_monster_at(sx + x, sy + y) && los(sx + x, sy + y))
+  /* Sprites are larger than a tile, so look one tile beyond the view */
+  visible_tiles(&session->camera, 1, &r);
+
+  for (y = r.y0; y < r.y1; y++)
+    for (x = r.x0; x < r.x1; x++)
+      if (is_monster_at(x, y) && los(x, y))
       {
-        struct monster *m = get_monster_at(sx + x, sy + y);
+        struct monster *mi = get_monster_at(x, y);
 
-        draw_actor(&m->a);
+        draw_actor(&mi->a);
       }
 }
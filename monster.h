@@ -118,10 +118,6 @@ struct monster_struct
 };
 
 
-/* The global monster structure. */
-extern struct monster_struct m;
-
-
 
 /*
  * Global functions.
@@ -138,7 +134,9 @@ void init_monsters(void);
 void initialize_monsters(void);
 void build_monster_map(void);
 void create_monster_in(byte);
+BOOL init_monster_actor(struct actor *, byte);
 void create_population(void);
+void prefetch_monsters(byte);
 void move_monster(struct monster *m, enum facing dir);
 void move_monsters(void);
 void draw_monsters(void);
@@ -0,0 +1,430 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * net.c -- thin clients of the session server
+ *
+ * A client connects to the server over a local socket and takes over
+ * the player of one session.  Every tick the server reads the input of
+ * the client, steps the session and sends it a frame of what is on
+ * screen (see proto.c).  The client draws the frames with the usual
+ * tile map and sprites and sends back its input with the newest frame
+ * it has.  Sockets are of the sequenced packet kind, so every message
+ * arrives whole and in order; frames that do not fit into the socket
+ * buffer are dropped, later frames are encoded against what the client
+ * has.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ctrl.h"
+#include "sprite.h"
+#include "session.h"
+#include "net.h"
+
+static BOOL socket_address(const char *path, struct sockaddr_un *sa)
+{
+  memset(sa, 0, sizeof(*sa));
+  sa->sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(sa->sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return FALSE;
+  }
+
+  strcpy(sa->sun_path, path);
+  return TRUE;
+}
+
+/*
+ * Listen for clients on the socket 'path'.  Returns the listening socket,
+ * which does not block, or -1.
+ */
+
+int listen_clients(const char *path)
+{
+  struct sockaddr_un sa;
+  int fd;
+
+  if (!socket_address(path, &sa))
+    return -1;
+
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  unlink(path);
+  if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+      listen(fd, 8) < 0 ||
+      fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*
+ * Accept one waiting client, NULL if there is none.
+ */
+
+struct client *accept_client(int listen_fd)
+{
+  struct client *c;
+  int fd;
+
+  fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0)
+    return NULL;
+
+  c = calloc(1, sizeof(struct client));
+  if (c == NULL) {
+    close(fd);
+    return NULL;
+  }
+
+  c->fd = fd;
+  clock_gettime(CLOCK_MONOTONIC, &c->since);
+
+  return c;
+}
+
+void free_client(struct client *c)
+{
+  struct timespec now;
+  double secs;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = (now.tv_sec - c->since.tv_sec) +
+         (now.tv_nsec - c->since.tv_nsec) / 1e9;
+
+  printf("client: %lu frames (%lu keyframes) in %.1f s, "
+         "%.1f bytes/frame, %.2f KB/s out, %.2f KB/s in\n",
+         c->frames, c->keyframes, secs,
+         c->frames ? (double) c->bytes_out / c->frames : 0.0,
+         secs > 0 ? c->bytes_out / secs / 1024 : 0.0,
+         secs > 0 ? c->bytes_in / secs / 1024 : 0.0);
+
+  close(c->fd);
+  free(c);
+}
+
+/*
+ * Take all the input the client sent since the last tick.  Returns FALSE
+ * once the client is gone.
+ */
+
+BOOL read_client(struct client *c)
+{
+  unsigned char buf[MAX_INPUT_LEN];
+  int n, held, pressed;
+  uint32 ack;
+
+  for (;;) {
+    n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    if (n == 0)
+      return FALSE;
+
+    c->bytes_in += n;
+    if (!decode_input(buf, n, &ack, &held, &pressed))
+      continue;
+
+    /* Acknowledgements of frames never sent are ignored */
+    if (ack > c->ack && ack <= c->tick)
+      c->ack = ack;
+    c->held = held;
+    c->pressed |= pressed;
+  }
+}
+
+/* The tile a local game would show at x, y */
+static ubyte shown_tile(coord x, coord y)
+{
+  if (is_known(x, y))
+    return gfx_at(x, y) + 1;
+
+  /* The top of a wall shows above a known wall face */
+  if (y + 1 < MAP_H && is_known(x, y + 1) && gfx_at(x, y + 1) == TILE_BOTTOM)
+    return gfx_at(x, y) + 1;
+
+  return 0;
+}
+
+static void add_actor(struct view *v, int id, int kind, struct actor *a)
+{
+  struct view_actor *va = &v->a[v->num_actors++];
+
+  va->id = id;
+  va->kind = kind;
+  va->frame = a->base_frame + a->delta_frame;
+  va->x = a->x;
+  va->y = a->y;
+}
+
+/*
+ * Capture what the player of the current session sees, the same things
+ * update_screen draws.
+ */
+
+void capture_view(struct view *v)
+{
+  struct message_log *log = &session->log;
+  struct tile_rect r;
+  struct monster *mi;
+  coord x, y;
+  int i;
+
+  v->dl = d.dl;
+  for (x = 0; x < MAP_W; x++)
+    for (y = 0; y < MAP_H; y++)
+      v->tile[x][y] = shown_tile(x, y);
+
+  v->num_actors = 0;
+  visible_tiles(&session->camera, 1, &r);
+  for (y = r.y0; y < r.y1; y++)
+    for (x = r.x0; x < r.x1; x++)
+      if (is_monster_at(x, y) && los(x, y)) {
+        mi = get_monster_at(x, y);
+        add_actor(v, session->midx[x][y], mi->midx, &mi->a);
+      }
+  add_actor(v, PLAYER_ID, 0, &d.pa);
+
+  for (i = 0; i < MAX_ATTRIBUTE; i++)
+    v->hud[i] = d.pc.attribute[i];
+  v->hud[HUD_HITS] = d.pc.hits;
+  v->hud[HUD_MAX_HITS] = d.pc.max_hits;
+  v->hud[HUD_POWER] = d.pc.power;
+  v->hud[HUD_MAX_POWER] = d.pc.max_power;
+  v->hud[HUD_EXPERIENCE] = d.pc.experience;
+  strcpy(v->name, d.pc.name);
+
+  v->msg_serial = log->serial;
+  v->msg[0] = '\0';
+  if (log->count)
+    strcpy(v->msg,
+           log->e[(log->head - 1 + MESSAGE_LOG_SIZE) % MESSAGE_LOG_SIZE].text);
+}
+
+/*
+ * Send the client a frame of the current session.
+ */
+
+void send_view(struct client *c)
+{
+  unsigned char buf[MAX_FRAME_LEN];
+  struct view *v, *base = NULL;
+  int n;
+
+  v = &c->ring[++c->tick % VIEW_RING];
+  capture_view(v);
+  v->tick = c->tick;
+
+  if (c->ack && c->tick - c->ack < VIEW_RING)
+    base = &c->ring[c->ack % VIEW_RING];
+
+  n = encode_frame(base, v, buf);
+  if (send(c->fd, buf, n, MSG_DONTWAIT | MSG_NOSIGNAL) != n)
+    return;
+
+  c->frames++;
+  c->bytes_out += n;
+  if (base == NULL)
+    c->keyframes++;
+}
+
+
+
+/*
+ * The client side, also used by spectators (see broadcast.c).
+ */
+
+static struct actor client_actor[MONSTERS_PER_LEVEL];
+static int client_kind[MONSTERS_PER_LEVEL];
+
+/*
+ * Bring the tile map, actors and status line of the current session from
+ * the view 'shown' up to the view 'v'.
+ */
+
+void apply_view(const struct view *v, struct view *shown)
+{
+  const struct view_actor *va;
+  struct actor *a;
+  coord x, y;
+  int i;
+
+  if (shown->tick == 0 || v->dl != shown->dl) {
+    d.dl = v->dl;
+    session->start_tile = d.dl * NUM_TILES;
+    clear_map(session->tile_map, session->start_tile + TILE_UNKNOWN);
+    memset(shown->tile, 0, sizeof(shown->tile));
+  }
+
+  for (x = 0; x < MAP_W; x++)
+    for (y = 0; y < MAP_H; y++)
+      if (v->tile[x][y] != shown->tile[x][y])
+        puttile_map(session->tile_map, x, y, session->start_tile +
+                    (v->tile[x][y] ? v->tile[x][y] - 1 : TILE_UNKNOWN));
+
+  for (i = 0; i < v->num_actors; i++) {
+    va = &v->a[i];
+    if (va->id == PLAYER_ID)
+      a = &d.pa;
+    else {
+      a = &client_actor[va->id];
+      if (client_kind[va->id] != va->kind + 1) {
+        if (!init_monster_actor(a, va->kind))
+          continue;
+        client_kind[va->id] = va->kind + 1;
+      }
+    }
+
+    a->x = va->x;
+    a->y = va->y;
+    a->base_frame = va->frame;
+    a->delta_frame = 0;
+  }
+
+  if (memcmp(v->hud, shown->hud, sizeof(v->hud)) != 0 ||
+      strcmp(v->name, shown->name) != 0) {
+    for (i = 0; i < MAX_ATTRIBUTE; i++)
+      d.pc.attribute[i] = v->hud[i];
+    d.pc.hits = v->hud[HUD_HITS];
+    d.pc.max_hits = v->hud[HUD_MAX_HITS];
+    d.pc.power = v->hud[HUD_POWER];
+    d.pc.max_power = v->hud[HUD_MAX_POWER];
+    d.pc.experience = v->hud[HUD_EXPERIENCE];
+    strcpy(d.pc.name, v->name);
+    update_necessary = TRUE;
+  }
+
+  if (v->msg_serial != shown->msg_serial && v->msg[0])
+    message("%s", v->msg);
+
+  memcpy(shown, v, sizeof(struct view));
+}
+
+/* Draw the view the current session was brought up to */
+void draw_view(const struct view *v)
+{
+  int i;
+
+  move_dungeon();
+  draw_dungeon();
+  for (i = 0; i < v->num_actors; i++)
+    if (v->a[i].id != PLAYER_ID && client_kind[v->a[i].id])
+      draw_actor(&client_actor[v->a[i].id]);
+  draw_actor(&d.pa);
+
+  draw_messages();
+  draw_player_status();
+  draw_hud();
+
+  flush_sprites();
+  flip();
+}
+
+/*
+ * Play a server session on this display.  The current session only
+ * provides the tile map, sprites and status line.
+ */
+
+int run_client(const char *path)
+{
+  unsigned char buf[MAX_FRAME_LEN];
+  struct sockaddr_un sa;
+  struct view *ring, *shown, *v;
+  struct pollfd pfd;
+  uint32 latest = 0;
+  int fd, n, held, pressed;
+
+  if (!socket_address(path, &sa))
+    return 1;
+
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+    perror(path);
+    return 1;
+  }
+
+  ring = calloc(VIEW_RING, sizeof(struct view));
+  shown = calloc(1, sizeof(struct view));
+  if (ring == NULL || shown == NULL) {
+    fprintf(stderr, "Fatal Error -- Out of memory\n");
+    return 1;
+  }
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  for (;;)
+  {
+    pump_input();
+    take_input(SDL_GetTicks(), &held, &pressed);
+    if (held & PRESS_ESC)
+      break;
+
+    /* The log is scrolled here, the server has no message line to show */
+    if (pressed & PRESS_LOG)
+      scroll_messages();
+    pressed &= ~PRESS_LOG;
+
+    n = encode_input(latest, held, pressed, buf);
+    if (send(fd, buf, n, MSG_NOSIGNAL) != n)
+      break;
+
+    /* Wait for the next frame, then take everything that arrived */
+    if (poll(&pfd, 1, 2 * TICK_MS) < 0 && errno != EINTR)
+      break;
+
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+    {
+      v = decode_frame(buf, n, ring);
+      if (v != NULL && v->tick > latest)
+        latest = v->tick;
+    }
+    if (n == 0)
+      break;
+
+    if (latest && latest != shown->tick)
+      apply_view(&ring[latest % VIEW_RING], shown);
+    if (shown->tick)
+      draw_view(shown);
+  }
+
+  close(fd);
+  free(ring);
+  free(shown);
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * net.h -- thin clients of the session server
+ * header for net.c
+ */
+
+#ifndef _net_h
+#define _net_h
+
+#include <time.h>
+
+#include "proto.h"
+
+/*
+ * A client connected to a server session.
+ */
+
+struct client
+{
+  int fd;
+
+  /* The last frame sent and the newest frame the client decoded */
+  uint32 tick, ack;
+
+  /* Input from the client, presses are kept until the player is idle */
+  int held, pressed;
+
+  /* Traffic */
+  unsigned long bytes_out, bytes_in, frames, keyframes;
+  struct timespec since;
+
+  /* The frames sent, to encode the next ones against */
+  struct view ring[VIEW_RING];
+};
+
+extern int listen_clients(const char *path);
+extern struct client *accept_client(int listen_fd);
+extern void free_client(struct client *c);
+extern BOOL read_client(struct client *c);
+extern void send_view(struct client *c);
+extern void capture_view(struct view *v);
+extern void apply_view(const struct view *v, struct view *shown);
+extern void draw_view(const struct view *v);
+extern int run_client(const char *path);
+
+#endif
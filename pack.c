@@ -0,0 +1,124 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * pack.c -- pre-decoded asset pack
+ *
+ * The pack built by edompack holds every sheet already decoded in the
+ * display format.  It is mapped copy-on-write, so the surfaces created
+ * from it use the mapped pixels directly and nothing is decoded or copied
+ * at startup.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pack.h"
+
+static unsigned char *pack_base;
+static size_t pack_size;
+
+int open_pack(const char *fn)
+{
+  const struct pack_header *hdr;
+  const struct pack_entry *e;
+  struct stat st;
+  uint32_t i;
+  void *base;
+  int fd;
+
+  close_pack();
+
+  fd = open(fn, O_RDONLY);
+  if (fd < 0)
+    return 0;
+
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct pack_header))
+  {
+    close(fd);
+    return 0;
+  }
+
+  base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return 0;
+
+  pack_base = base;
+  pack_size = st.st_size;
+
+  /* Check the index before trusting any offset */
+  hdr = base;
+  if (hdr->magic != PACK_MAGIC || hdr->version != PACK_VERSION ||
+      hdr->count > (pack_size - sizeof(*hdr)) / sizeof(*e))
+  {
+    fprintf(stderr, "Ignoring invalid asset pack %s\n", fn);
+    close_pack();
+    return 0;
+  }
+
+  e = (const struct pack_entry *) (hdr + 1);
+  for (i = 0; i < hdr->count; i++, e++)
+    if (e->name[PACK_NAME_LEN - 1] != '\0' || e->pitch < e->w * 4 ||
+        e->offset % PACK_ALIGN || e->offset > pack_size ||
+        (uint64_t) e->pitch * e->h > pack_size - e->offset)
+    {
+      fprintf(stderr, "Ignoring invalid asset pack %s\n", fn);
+      close_pack();
+      return 0;
+    }
+
+  return 1;
+}
+
+void close_pack(void)
+{
+  if (pack_base != NULL)
+    munmap(pack_base, pack_size);
+
+  pack_base = NULL;
+  pack_size = 0;
+}
+
+const struct pack_entry *find_pack_entry(const char *name)
+{
+  const struct pack_header *hdr = (const struct pack_header *) pack_base;
+  const struct pack_entry *e;
+  uint32_t i;
+
+  if (hdr == NULL)
+    return NULL;
+
+  e = (const struct pack_entry *) (hdr + 1);
+  for (i = 0; i < hdr->count; i++, e++)
+    if (strncmp(e->name, name, PACK_NAME_LEN) == 0)
+      return e;
+
+  return NULL;
+}
+
+void *pack_pixels(const struct pack_entry *e)
+{
+  return pack_base + e->offset;
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * pack.h -- pre-decoded asset pack
+ * header for pack.c
+ */
+
+#ifndef _pack_h
+#define _pack_h
+
+#include <stdint.h>
+
+#define DEFAULT_PACK	"edom.pak"
+
+#define PACK_MAGIC	0x4b504445	/* "EDPK" */
+#define PACK_VERSION	1
+
+/* Sheets and pixel data start on a cache line */
+#define PACK_ALIGN	64
+
+#define PACK_NAME_LEN	32
+
+/* Pixels are 32 bit words in the usual display format */
+#define PACK_RMASK	0x00ff0000
+#define PACK_GMASK	0x0000ff00
+#define PACK_BMASK	0x000000ff
+#define PACK_AMASK	0xff000000
+
+/* Sheet is drawn with per pixel alpha */
+#define PACK_ALPHA	1
+
+struct pack_header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+/* One entry per sheet follows the header */
+struct pack_entry
+{
+  char name[PACK_NAME_LEN];
+  uint32_t w, h;
+  uint32_t pitch;
+  uint32_t flags;
+  uint64_t offset;
+};
+
+extern int open_pack(const char *fn);
+extern void close_pack(void);
+extern const struct pack_entry *find_pack_entry(const char *name);
+extern void *pack_pixels(const struct pack_entry *e);
+
+#endif
@@ -32,8 +32,28 @@
  * Global variables.
  */
 
-/* Update the player status line? */
-BOOL update_necessary = TRUE;
+/* Fields of the status line. */
+enum status_field
+{
+  SF_NAME, SF_STRENGTH, SF_INTELLIGENCE, SF_DEXTERITY, SF_TOUGHNESS, SF_MANA,
+  SF_HITS, SF_MAX_HITS, SF_POWER, SF_MAX_POWER, SF_EXPERIENCE,
+  MAX_STATUS_FIELD
+};
+
+/* Label in front of each field and the field width. */
+static struct
+{
+  char *label;
+  byte len;
+} status_layout[MAX_STATUS_FIELD] =
+{
+  { "", 8 }, { "  St:", 2 }, { "  In:", 2 }, { "  Dx:", 2 }, { "  To:", 2 },
+  { "  Ma:", 2 }, { "  H:", 3 }, { "(", 3 }, { ")  P:", 3 }, { "(", 3 },
+  { ")  X:", 7 }
+};
+
+/* Head-up display fields of the status line. */
+static int status_field[MAX_STATUS_FIELD];
 
 /* String constants for the training skills. */
 static char *tskill_s[MAX_T_SKILL] =
@@ -132,32 +152,51 @@ byte get_attribute(byte attribute)
 
 
 
+/*
+ * Create the status line on the head-up display.
+ */
+
+void init_status(void)
+{
+  int i, x = FNT_W;
+
+  hud_box(0, MSG_H, screen_width - 2 * FNT_W, FNT_H);
+
+  for (i = 0; i < MAX_STATUS_FIELD; i++)
+  {
+    hud_label(x, MSG_H + FNT_H, status_layout[i].label);
+    x += strlen(status_layout[i].label) * FNT_W;
+
+    status_field[i] = hud_field(x, MSG_H + FNT_H, status_layout[i].len);
+    x += status_layout[i].len * FNT_W;
+  }
+
+  update_necessary = TRUE;
+}
+
+
+
 /*
  * Draw the status line.
+ *
+ * Only the fields that changed are drawn again.
  */
 
 void draw_player_status(void)
 {
-  static char str[80];
-
   if (update_necessary)
   {
-    sprintf(str,
-           "%s   St:%d  In:%d  Dx:%d  To:%d  Ma:%d  H:%d(%d)  P:%d(%d)  X:%ld"
-            , d.pc.name
-            , (int) d.pc.attribute[STRENGTH]
-            , (int) d.pc.attribute[INTELLIGENCE]
-            , (int) d.pc.attribute[DEXTERITY]
-            , (int) d.pc.attribute[TOUGHNESS]
-            , (int) d.pc.attribute[MANA]
-            , (int) d.pc.hits
-            , (int) d.pc.max_hits
-            , (int) d.pc.power
-            , (int) d.pc.max_power
-            , (long) d.pc.experience);
-
-    draw_fixed_text(0, screen_height + MSG_H, screen_width - 2 * FNT_W, str,
-                    font);
+    hud_text(status_field[SF_NAME], d.pc.name);
+    hud_number(status_field[SF_STRENGTH], d.pc.attribute[STRENGTH]);
+    hud_number(status_field[SF_INTELLIGENCE], d.pc.attribute[INTELLIGENCE]);
+    hud_number(status_field[SF_DEXTERITY], d.pc.attribute[DEXTERITY]);
+    hud_number(status_field[SF_TOUGHNESS], d.pc.attribute[TOUGHNESS]);
+    hud_number(status_field[SF_MANA], d.pc.attribute[MANA]);
+    hud_number(status_field[SF_HITS], d.pc.hits);
+    hud_number(status_field[SF_MAX_HITS], d.pc.max_hits);
+    hud_number(status_field[SF_POWER], d.pc.power);
+    hud_number(status_field[SF_MAX_POWER], d.pc.max_power);
+    hud_number(status_field[SF_EXPERIENCE], d.pc.experience);
 
     update_necessary = FALSE;
   }
@@ -486,6 +525,10 @@ void place_player(byte px, byte py)
   d.pa.dy = 0;
 
   set_dir_actor(&d.pa, DOWN);
+
+  /* Jump to the new position rather than scroll there */
+  center_camera(&session->camera, d.pa.x + TILE_WIDTH / 2,
+                d.pa.y + TILE_HEIGHT / 2);
 }
 
 void move_player(enum facing dir)
@@ -495,6 +538,12 @@ void move_player(enum facing dir)
     move_actor(&d.pa, dir);
     d.px += d.pa.dx;
     d.py += d.pa.dy;
+
+    /* Load the next level's monsters while the player is on the stairs */
+    if (session->render && tile_at(d.px, d.py) == STAIR_DOWN)
+      prefetch_monsters(d.dl + 1);
+    else if (session->render && tile_at(d.px, d.py) == STAIR_UP)
+      prefetch_monsters(d.dl - 1);
   }
 }
 
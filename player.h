@@ -92,10 +92,11 @@ struct player
 
 
 /*
- * Global variables.
+ * Session variables.
  */
 
-extern BOOL update_necessary;
+/* Update the player status line? */
+#define update_necessary (session->status_dirty)
 
 
 
@@ -106,6 +107,7 @@ extern BOOL update_necessary;
 byte get_attribute(byte);
 
 void init_player(void);
+void init_status(void);
 void draw_player_status(void);
 void set_attribute(byte, byte);
 void adjust_training(void);
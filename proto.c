@@ -0,0 +1,405 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * proto.c -- thin client protocol
+ *
+ * The server sends clients what is on screen rather than pixels: the
+ * tiles shown, the actors in view and the status line.  Each frame is
+ * encoded against the newest frame the client acknowledged, so a frame
+ * only carries what changed since then.  A client that acknowledged
+ * nothing, or fell too far behind, gets a keyframe, which is a frame
+ * encoded against an empty view.  Both ends keep the last VIEW_RING
+ * views to encode and decode against.
+ *
+ * Frame:  'F' tick base dl tiles actors hud strings
+ * Input:  'I' ack held pressed
+ *
+ * Numbers are unsigned LEB128 varints, differences are zigzag encoded
+ * first.  Tiles are runs over the cells in map order: a count of cells
+ * that did not change, a count of cells that did and their new tiles,
+ * until the whole map is covered.
+ */
+
+#include <string.h>
+
+#include "proto.h"
+
+/* Fields of an actor that follow its id */
+#define A_KIND  1
+#define A_X     2
+#define A_Y     4
+#define A_FRAME 8
+
+/* Strings that follow the status values */
+#define S_NAME 1
+#define S_MSG  2
+
+#define NUM_CELLS (MAP_W * MAP_H)
+
+struct reader
+{
+  const unsigned char *p, *end;
+  BOOL bad;
+};
+
+static const struct view empty_view;
+
+static unsigned char *put_varint(unsigned char *p, uint32 v)
+{
+  while (v >= 0x80) {
+    *p++ = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+
+  return p;
+}
+
+static unsigned char *put_zigzag(unsigned char *p, int32 v)
+{
+  return put_varint(p, ((uint32) v << 1) ^ (uint32) -(v < 0));
+}
+
+static unsigned char *put_string(unsigned char *p, const char *s, int max)
+{
+  int len = strnlen(s, max - 1);
+
+  p = put_varint(p, len);
+  memcpy(p, s, len);
+
+  return p + len;
+}
+
+static int get_byte(struct reader *r)
+{
+  if (r->p >= r->end) {
+    r->bad = TRUE;
+    return 0;
+  }
+
+  return *r->p++;
+}
+
+static uint32 get_varint(struct reader *r)
+{
+  uint32 v = 0;
+  int shift, c;
+
+  for (shift = 0; shift < 35; shift += 7) {
+    c = get_byte(r);
+    v |= (uint32) (c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return v;
+  }
+
+  r->bad = TRUE;
+  return 0;
+}
+
+static int32 get_zigzag(struct reader *r)
+{
+  uint32 v = get_varint(r);
+
+  return (int32) (v >> 1) ^ -(int32) (v & 1);
+}
+
+static void get_string(struct reader *r, char *s, int max)
+{
+  uint32 len = get_varint(r);
+
+  if (len > (uint32) (max - 1) || len > (uint32) (r->end - r->p)) {
+    r->bad = TRUE;
+    len = 0;
+  }
+
+  memcpy(s, r->p, len);
+  s[len] = '\0';
+  r->p += len;
+}
+
+static unsigned char *encode_tiles(const struct view *base,
+                                   const struct view *v, unsigned char *p)
+{
+  const ubyte *a = &base->tile[0][0], *b = &v->tile[0][0];
+  int i = 0, start, skip;
+
+  while (i < NUM_CELLS) {
+
+    for (start = i; i < NUM_CELLS && a[i] == b[i]; i++);
+    skip = i - start;
+
+    for (start = i; i < NUM_CELLS && a[i] != b[i]; i++);
+
+    p = put_varint(p, skip);
+    p = put_varint(p, i - start);
+    memcpy(p, b + start, i - start);
+    p += i - start;
+  }
+
+  return p;
+}
+
+static void decode_tiles(struct reader *r, const struct view *base,
+                         struct view *v)
+{
+  const ubyte *a = &base->tile[0][0];
+  ubyte *b = &v->tile[0][0];
+  uint32 skip, n;
+  int i = 0;
+
+  while (i < NUM_CELLS && !r->bad) {
+
+    skip = get_varint(r);
+    n = get_varint(r);
+    if (skip > (uint32) (NUM_CELLS - i) ||
+        n > (uint32) (NUM_CELLS - i) - skip ||
+        n > (uint32) (r->end - r->p)) {
+      r->bad = TRUE;
+      return;
+    }
+
+    memcpy(b + i, a + i, skip);
+    i += skip;
+    memcpy(b + i, r->p, n);
+    i += n;
+    r->p += n;
+  }
+}
+
+static unsigned char *encode_actors(const struct view *base,
+                                    const struct view *v, unsigned char *p)
+{
+  static const struct view_actor none;
+  const struct view_actor *a, *o;
+  ubyte in_base[MAX_VIEW_ACTORS];
+  int i, mask;
+
+  memset(in_base, 0xff, sizeof(in_base));
+  for (i = 0; i < base->num_actors; i++)
+    in_base[base->a[i].id] = i;
+
+  p = put_varint(p, v->num_actors);
+
+  for (i = 0; i < v->num_actors; i++) {
+
+    a = &v->a[i];
+    o = in_base[a->id] == 0xff ? &none : &base->a[in_base[a->id]];
+
+    mask = 0;
+    if (a->kind != o->kind || o == &none) mask |= A_KIND;
+    if (a->x != o->x) mask |= A_X;
+    if (a->y != o->y) mask |= A_Y;
+    if (a->frame != o->frame) mask |= A_FRAME;
+
+    *p++ = a->id;
+    *p++ = mask;
+    if (mask & A_KIND) *p++ = a->kind;
+    if (mask & A_X) p = put_zigzag(p, a->x - o->x);
+    if (mask & A_Y) p = put_zigzag(p, a->y - o->y);
+    if (mask & A_FRAME) *p++ = a->frame;
+  }
+
+  return p;
+}
+
+static void decode_actors(struct reader *r, const struct view *base,
+                          struct view *v)
+{
+  static const struct view_actor none;
+  const struct view_actor *o;
+  struct view_actor *a;
+  ubyte in_base[MAX_VIEW_ACTORS];
+  int i, mask;
+
+  memset(in_base, 0xff, sizeof(in_base));
+  for (i = 0; i < base->num_actors; i++)
+    in_base[base->a[i].id] = i;
+
+  v->num_actors = get_varint(r);
+  if (v->num_actors > MAX_VIEW_ACTORS) {
+    r->bad = TRUE;
+    return;
+  }
+
+  for (i = 0; i < v->num_actors && !r->bad; i++) {
+
+    a = &v->a[i];
+    a->id = get_byte(r);
+    mask = get_byte(r);
+    if (a->id >= MAX_VIEW_ACTORS) {
+      r->bad = TRUE;
+      return;
+    }
+
+    /* Actors new to the client send every field */
+    o = in_base[a->id] == 0xff ? &none : &base->a[in_base[a->id]];
+
+    a->kind = (mask & A_KIND) ? get_byte(r) : o->kind;
+    a->x = o->x + ((mask & A_X) ? get_zigzag(r) : 0);
+    a->y = o->y + ((mask & A_Y) ? get_zigzag(r) : 0);
+    a->frame = (mask & A_FRAME) ? get_byte(r) : o->frame;
+  }
+}
+
+/*
+ * Encode 'v' against 'base', or as a keyframe if 'base' is NULL.  'buf'
+ * must hold MAX_FRAME_LEN bytes.  Returns the length of the frame.
+ */
+
+int encode_frame(const struct view *base, const struct view *v,
+                 unsigned char *buf)
+{
+  unsigned char *p = buf, *mask_at;
+  uint32 changed = 0;
+  int i, strings = 0;
+
+  if (base == NULL)
+    base = &empty_view;
+
+  *p++ = MSG_FRAME;
+  p = put_varint(p, v->tick);
+  p = put_varint(p, base->tick);
+  *p++ = v->dl;
+
+  p = encode_tiles(base, v, p);
+  p = encode_actors(base, v, p);
+
+  for (i = 0; i < MAX_HUD_VALUE; i++)
+    if (v->hud[i] != base->hud[i])
+      changed |= 1 << i;
+  p = put_varint(p, changed);
+  for (i = 0; i < MAX_HUD_VALUE; i++)
+    if (changed & (1 << i))
+      p = put_zigzag(p, v->hud[i] - base->hud[i]);
+
+  if (strcmp(v->name, base->name) != 0)
+    strings |= S_NAME;
+  if (v->msg_serial != base->msg_serial)
+    strings |= S_MSG;
+
+  mask_at = p++;
+  *mask_at = strings;
+  if (strings & S_NAME)
+    p = put_string(p, v->name, sizeof(v->name));
+  if (strings & S_MSG) {
+    p = put_varint(p, v->msg_serial);
+    p = put_string(p, v->msg, sizeof(v->msg));
+  }
+
+  return p - buf;
+}
+
+/*
+ * Decode a frame into the ring of views it was encoded against.  Returns
+ * the new view, or NULL if the frame is malformed or its base is no
+ * longer in the ring.
+ */
+
+struct view *decode_frame(const unsigned char *buf, int len,
+                          struct view *ring)
+{
+  struct reader r = { buf, buf + len, FALSE };
+  const struct view *base;
+  struct view *v;
+  uint32 tick, base_tick, changed;
+  int i, strings;
+
+  if (get_byte(&r) != MSG_FRAME)
+    return NULL;
+
+  tick = get_varint(&r);
+  base_tick = get_varint(&r);
+  if (r.bad || tick == 0 || base_tick >= tick ||
+      (base_tick && tick - base_tick >= VIEW_RING))
+    return NULL;
+
+  base = &empty_view;
+  if (base_tick) {
+    base = &ring[base_tick % VIEW_RING];
+    if (base->tick != base_tick)
+      return NULL;
+  }
+
+  v = &ring[tick % VIEW_RING];
+  v->tick = 0;
+  v->dl = get_byte(&r);
+
+  decode_tiles(&r, base, v);
+  decode_actors(&r, base, v);
+
+  changed = get_varint(&r);
+  for (i = 0; i < MAX_HUD_VALUE; i++)
+    v->hud[i] = base->hud[i] +
+                ((changed & (1 << i)) ? get_zigzag(&r) : 0);
+
+  strings = get_byte(&r);
+  if (strings & S_NAME)
+    get_string(&r, v->name, sizeof(v->name));
+  else
+    strcpy(v->name, base->name);
+
+  if (strings & S_MSG) {
+    v->msg_serial = get_varint(&r);
+    get_string(&r, v->msg, sizeof(v->msg));
+  }
+  else {
+    v->msg_serial = base->msg_serial;
+    strcpy(v->msg, base->msg);
+  }
+
+  if (r.bad || r.p != r.end)
+    return NULL;
+
+  v->tick = tick;
+  return v;
+}
+
+/*
+ * The client sends its input once per frame, with the newest frame it
+ * decoded.  'buf' must hold MAX_INPUT_LEN bytes.
+ */
+
+int encode_input(uint32 ack, int held, int pressed, unsigned char *buf)
+{
+  unsigned char *p = buf;
+
+  *p++ = MSG_INPUT;
+  p = put_varint(p, ack);
+  p = put_varint(p, held);
+  p = put_varint(p, pressed);
+
+  return p - buf;
+}
+
+BOOL decode_input(const unsigned char *buf, int len,
+                  uint32 *ack, int *held, int *pressed)
+{
+  struct reader r = { buf, buf + len, FALSE };
+
+  if (get_byte(&r) != MSG_INPUT)
+    return FALSE;
+
+  *ack = get_varint(&r);
+  *held = get_varint(&r);
+  *pressed = get_varint(&r);
+
+  return !r.bad && r.p == r.end;
+}
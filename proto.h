@@ -0,0 +1,100 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * proto.h -- thin client protocol
+ * header for proto.c
+ */
+
+#ifndef _proto_h
+#define _proto_h
+
+#include "main.h"
+
+/* Message types, the first byte of every message */
+#define MSG_FRAME 'F'
+#define MSG_INPUT 'I'
+
+/* Views both ends keep to encode and decode frames against */
+#define VIEW_RING 16
+
+/* The player is sent after the monster slots of a level */
+#define PLAYER_ID MONSTERS_PER_LEVEL
+#define MAX_VIEW_ACTORS (MONSTERS_PER_LEVEL + 1)
+
+/* Status line values: the attributes, then these */
+#define HUD_HITS        (MAX_ATTRIBUTE)
+#define HUD_MAX_HITS    (MAX_ATTRIBUTE + 1)
+#define HUD_POWER       (MAX_ATTRIBUTE + 2)
+#define HUD_MAX_POWER   (MAX_ATTRIBUTE + 3)
+#define HUD_EXPERIENCE  (MAX_ATTRIBUTE + 4)
+#define MAX_HUD_VALUE   (MAX_ATTRIBUTE + 5)
+
+/* Upper bounds of encoded messages */
+#define MAX_FRAME_LEN 10240
+#define MAX_INPUT_LEN 16
+
+struct view_actor
+{
+  /* Monster slot or PLAYER_ID, and the monster type */
+  ubyte id, kind;
+
+  /* Sprite frame */
+  ubyte frame;
+
+  /* Position in map pixels */
+  int16 x, y;
+};
+
+/*
+ * Everything a client needs to draw one frame of a session.
+ */
+
+struct view
+{
+  /* Frame number, 0 is no frame */
+  uint32 tick;
+
+  byte dl;
+
+  /* The tile shown in every cell plus one, 0 while it is unknown */
+  ubyte tile[MAP_W][MAP_H];
+
+  int num_actors;
+  struct view_actor a[MAX_VIEW_ACTORS];
+
+  int32 hud[MAX_HUD_VALUE];
+  char name[MAX_PC_NAME_LENGTH + 1];
+
+  /* The newest message and how many messages were given so far */
+  int msg_serial;
+  char msg[MESSAGE_LEN];
+};
+
+extern int encode_frame(const struct view *base, const struct view *v,
+                        unsigned char *buf);
+extern struct view *decode_frame(const unsigned char *buf, int len,
+                                 struct view *ring);
+extern int encode_input(uint32 ack, int held, int pressed,
+                        unsigned char *buf);
+extern BOOL decode_input(const unsigned char *buf, int len,
+                         uint32 *ack, int *held, int *pressed);
+
+#endif
@@ -0,0 +1,352 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * session.c -- game sessions and the session server
+ *
+ * All the state of one game lives in a session.  The interactive game
+ * runs one session on the main thread.  The server runs many sessions on
+ * a pool of worker threads; every tick each session is stepped once, by
+ * whichever worker claims it.  A thread enters a session before it calls
+ * into the game and leaves it afterwards, which also swaps in the random
+ * number state of the session.
+ *
+ * A server that listens on a socket ticks at a fixed rate.  Clients that
+ * connect take over the player of a free session from the bot until they
+ * leave (see net.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ctrl.h"
+#include "session.h"
+#include "net.h"
+
+__thread struct session *session;
+
+struct server
+{
+  struct session **s;
+  int nsessions, ticks;
+  rand_type seed;
+  int level;
+
+  /* Socket clients connect to, -1 if none, and when the next tick starts */
+  int listen_fd;
+  struct timespec next_tick;
+
+  /* Next session block to claim, reset between ticks */
+  int next;
+  pthread_barrier_t tick;
+};
+
+struct session *new_session(BOOL render)
+{
+  struct session *s;
+
+  if (posix_memalign((void **) &s, 64, sizeof(struct session)) != 0)
+    return NULL;
+
+  memset(s, 0, sizeof(struct session));
+  s->render = render;
+  s->rand_state = 1;
+  s->bot = 1;
+  s->log.dirty = TRUE;
+  s->status_dirty = TRUE;
+
+  return s;
+}
+
+void free_session(struct session *s)
+{
+  free_level_maps(s);
+  if (s->client != NULL)
+    free_client(s->client);
+  if (s->tile_map != NULL)
+    free_map(s->tile_map);
+  free(s);
+}
+
+void enter_session(struct session *s)
+{
+  session = s;
+  set_rand_state(s->rand_state);
+}
+
+void leave_session(void)
+{
+  session->rand_state = get_rand_state();
+  session = NULL;
+}
+
+/*
+ * Start a new game in a session that is not drawn: the dungeon is built
+ * from 'seed' and the player starts on 'level'.
+ */
+
+void start_session(struct session *s, rand_type seed, int level)
+{
+  enter_session(s);
+
+  d.seed = seed;
+  seed_rand(seed);
+  s->bot = seed | 1;
+  memset(&s->walk, 0, sizeof(s->walk));
+
+  init_player();
+  init_monsters();
+  init_dungeon();
+  start_game(level);
+
+  leave_session();
+}
+
+/*
+ * Server sessions have no players yet, a bot wanders about instead.  It
+ * keeps a direction for a while, digs into rock and takes stairs down.
+ */
+
+static uint32_t bot_rand(struct session *s)
+{
+  uint32_t x = s->bot;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return (s->bot = x);
+}
+
+static int bot_input(struct session *s, int *pressed)
+{
+  static const int dirs[4] = { PRESS_LEFT, PRESS_RIGHT, PRESS_UP, PRESS_DOWN };
+  uint32_t r = bot_rand(s);
+
+  *pressed = 0;
+  if (r % 16 == 0)
+    s->bot_held = dirs[(r >> 4) % 4];
+
+  if (tile_at(d.px, d.py) == STAIR_DOWN && d.dl < MAX_DUNGEON_LEVEL - 1)
+    *pressed = PRESS_ADVANCE;
+  else if ((r >> 8) % 64 == 0)
+    *pressed = PRESS_DIG;
+
+  return s->bot_held;
+}
+
+static void step_session(struct server *sv, int i)
+{
+  struct session *s = sv->s[i];
+  struct client *c = s->client;
+  int held, pressed;
+  BOOL idle, running;
+
+  enter_session(s);
+
+  if (c != NULL && !read_client(c)) {
+    free_client(c);
+    c = s->client = NULL;
+  }
+
+  if (c == NULL)
+    held = bot_input(s, &pressed);
+  else {
+    held = c->held;
+    pressed = c->pressed;
+  }
+
+  idle = d.pa.act == IDLE;
+  running = step_game(held, pressed);
+
+  /* Presses wait for the player to be idle */
+  if (c != NULL && running) {
+    if (idle)
+      c->pressed = 0;
+    send_view(c);
+  }
+
+  leave_session();
+
+  /* A game that ended drops its client and starts over */
+  if (!running) {
+    if (c != NULL) {
+      free_client(c);
+      s->client = NULL;
+    }
+    start_session(s, sv->seed + i, sv->level);
+  }
+}
+
+/*
+ * Hand waiting clients to sessions nobody plays yet, then wait for the
+ * next tick.
+ */
+
+static void serve_clients(struct server *sv)
+{
+  struct client *c;
+  int i = 0;
+
+  while ((c = accept_client(sv->listen_fd)) != NULL) {
+    while (i < sv->nsessions && sv->s[i]->client != NULL)
+      i++;
+    if (i == sv->nsessions) {
+      fprintf(stderr, "No free session for a client\n");
+      free_client(c);
+      continue;
+    }
+
+    sv->s[i]->client = c;
+    printf("client: playing session %d\n", i);
+    fflush(stdout);
+  }
+
+  sv->next_tick.tv_nsec += TICK_MS * 1000000L;
+  if (sv->next_tick.tv_nsec >= 1000000000L) {
+    sv->next_tick.tv_nsec -= 1000000000L;
+    sv->next_tick.tv_sec++;
+  }
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sv->next_tick, NULL);
+}
+
+static void *server_worker(void *arg)
+{
+  struct server *sv = arg;
+  int t, i, first;
+
+  /* Tick -1 starts the games, a listening server with no ticks runs on */
+  for (t = -1; t < sv->ticks || (sv->listen_fd >= 0 && !sv->ticks); t++) {
+
+    for (;;) {
+      first = __atomic_fetch_add(&sv->next, SESSION_BLOCK, __ATOMIC_RELAXED);
+      if (first >= sv->nsessions)
+        break;
+
+      for (i = first; i < first + SESSION_BLOCK && i < sv->nsessions; i++) {
+        if (t < 0)
+          start_session(sv->s[i], sv->seed + i, sv->level);
+        else
+          step_session(sv, i);
+      }
+    }
+
+    /* One thread resets the counter once everybody is done */
+    if (pthread_barrier_wait(&sv->tick) == PTHREAD_BARRIER_SERIAL_THREAD) {
+      __atomic_store_n(&sv->next, 0, __ATOMIC_RELAXED);
+      if (sv->listen_fd >= 0)
+        serve_clients(sv);
+    }
+    pthread_barrier_wait(&sv->tick);
+  }
+
+  return NULL;
+}
+
+static double elapsed(const struct timespec *t0)
+{
+  struct timespec t1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/*
+ * Run 'nsessions' games for 'ticks' frames on 'nthreads' workers.  Session
+ * i plays the dungeon from seed + i.  With a socket 'path' clients may
+ * connect and 'ticks' 0 runs until the server is killed.
+ */
+
+int run_server(int nsessions, int nthreads, int ticks, rand_type seed,
+               int level, const char *path)
+{
+  struct server sv;
+  struct timespec t0;
+  pthread_t *threads;
+  int i, levels = 0;
+  double secs;
+
+  memset(&sv, 0, sizeof(sv));
+  sv.nsessions = nsessions;
+  sv.ticks = ticks;
+  sv.seed = seed;
+  sv.level = level;
+  sv.listen_fd = -1;
+
+  if (path != NULL) {
+    sv.listen_fd = listen_clients(path);
+    if (sv.listen_fd < 0)
+      return 1;
+    printf("Listening on %s.\n", path);
+    fflush(stdout);
+  }
+
+  sv.s = malloc(sizeof(struct session *) * nsessions);
+  threads = malloc(sizeof(pthread_t) * nthreads);
+  if (sv.s == NULL || threads == NULL) {
+    fprintf(stderr, "Fatal Error -- Out of memory\n");
+    return 1;
+  }
+
+  for (i = 0; i < nsessions; i++) {
+    sv.s[i] = new_session(FALSE);
+    if (sv.s[i] == NULL) {
+      fprintf(stderr, "Fatal Error -- Unable to create session %d\n", i);
+      return 1;
+    }
+  }
+
+  pthread_barrier_init(&sv.tick, NULL, nthreads);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  sv.next_tick = t0;
+
+  for (i = 0; i < nthreads; i++)
+    pthread_create(&threads[i], NULL, server_worker, &sv);
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+
+  secs = elapsed(&t0);
+
+  for (i = 0; i < nsessions; i++) {
+    levels += sv.s[i]->dungeon.dl;
+    free_session(sv.s[i]);
+  }
+
+  printf("%d sessions, %d ticks in %.2f s on %d threads: "
+         "%.0f session ticks/s\n", nsessions, ticks, secs, nthreads,
+         (double) nsessions * ticks / secs);
+  printf("%lu bytes per session, %.1f levels descended on average\n",
+         (unsigned long) sizeof(struct session), (double) levels / nsessions);
+
+  pthread_barrier_destroy(&sv.tick);
+  if (sv.listen_fd >= 0) {
+    close(sv.listen_fd);
+    unlink(path);
+  }
+  free(threads);
+  free(sv.s);
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * session.h -- game sessions and the session server
+ * header for session.c
+ */
+
+#ifndef _session_h
+#define _session_h
+
+#include "main.h"
+
+/* Sessions a server worker claims at a time */
+#define SESSION_BLOCK 8
+
+extern struct session *new_session(BOOL render);
+extern void free_session(struct session *s);
+extern void enter_session(struct session *s);
+extern void leave_session(void);
+extern void start_session(struct session *s, rand_type seed, int level);
+extern int run_server(int nsessions, int nthreads, int ticks,
+                      rand_type seed, int level, const char *path);
+
+#endif
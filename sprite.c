@@ -20,11 +20,43 @@
 
 /*
  * sprite.c -- 2d sprite engine
+ *
+ * Sprites for the screen are queued on a per-frame draw list.  The list is
+ * sorted by layer and sheet when flushed, keeping the order of submission
+ * within one sheet.  Actors overlap each other, so their layer keeps the
+ * order of submission across sheets: whatever is queued later is drawn
+ * in front.
+ *
+ * When a sheet is loaded a table with the source rectangle of every frame
+ * is built, together with the bounds of its visible pixels so blended
+ * blits skip transparent borders.  An optional text file next to the
+ * image, "<image>.frames", gives per-frame metadata, one frame per line:
+ *
+ *   index anchor_x anchor_y [trim_x trim_y trim_w trim_h]
+ *
+ * Mostly transparent sheets such as the actors can also be packed into
+ * runs of visible pixels, converted to the screen format.  Packed frames
+ * are drawn to the screen by a span blitter whose cost depends only on
+ * the number of visible pixels.
+ *
+ * Sheets are kept in the screen layout so the screen can be composited
+ * without SDL.  When every queued sprite allows it, the screen is split
+ * into horizontal bands drawn by worker threads, each band clipped to its
+ * rows and drawn in the order of the list.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef SDL_GFX
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include "sprite.h"
+#include "blit.h"
+#include "pack.h"
+#include "metrics.h"
 
 #ifdef SDL_GFX
 #include "SDL_image.h"
@@ -33,8 +65,42 @@
 int window_width = DEFAULT_WINDOW_WIDTH;
 int window_height = DEFAULT_WINDOW_HEIGHT;
 
+static int num_sheets;
+
 #ifdef SDL_GFX
 static SDL_Surface *dest;
+static SDL_Surface *screen_dest;
+static SPRITE *target;
+static int target_blend;
+
+typedef struct
+{
+  /* Layer, sheet (not for actors) and submission order */
+  unsigned long long key;
+
+  SPRITE *spr;
+  int index;
+  int x, y;
+  int clip_x, clip_y, clip_w, clip_h;
+} SPRITE_CMD;
+
+static SPRITE_CMD *cmds;
+static int num_cmds, max_cmds;
+
+/* Bands need at least this many rows to be worth a thread */
+#define MAX_BANDS	8
+#define MIN_BAND_H	64
+
+static int num_bands = 1;
+static int dest_locked;
+
+static pthread_t band_threads[MAX_BANDS];
+static int band_workers;
+static pthread_mutex_t band_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t band_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t band_done = PTHREAD_COND_INITIALIZER;
+static unsigned long band_frame;
+static int bands_left;
 #else
 static GLXContext dest;
 #endif
@@ -45,156 +111,1202 @@ void set_sprite_context(void *cx, int w, int h)
   window_height = h;
 
 #ifdef SDL_GFX
-  dest = (SDL_Surface *) cx;
+  dest = screen_dest = (SDL_Surface *) cx;
+  select_blit();
+  set_sprite_bands(0);
 #else
   dest = (GLXContext) cx;
 #endif
 }
 
-SPRITE* load_sprite(const char *fn, int w, int h)
+static int init_frames(SPRITE *spr)
+{
+  SPRITE_FRAME *f;
+  int i;
+
+  spr->nframes = spr->nhsprites * spr->nvsprites;
+  spr->frames = malloc(sizeof(SPRITE_FRAME) *
+                       (spr->nframes ? spr->nframes : 1));
+  if (spr->frames == NULL) return 0;
+
+  /* Frames are laid out in rows with a one pixel border */
+  for (i = 0; i < spr->nframes; i++)
+  {
+    f = &spr->frames[i];
+
+    f->x = 1 + (i % spr->nhsprites) * (spr->w + 1);
+#ifdef SDL_GFX
+    f->y = 1 + (i / spr->nhsprites) * (spr->h + 1);
+#else
+    f->y = spr->nvsprites * spr->h - (i / spr->nhsprites) * (spr->h + 1) - 1;
+#endif
+
+    f->tx = f->ty = 0;
+    f->tw = spr->w;
+    f->th = spr->h;
+    f->ax = f->ay = 0;
+  }
+
+  return 1;
+}
+
+#ifdef SDL_GFX
+
+static Uint32 get_pixel(SDL_Surface *s, int x, int y)
+{
+  Uint8 *p = (Uint8 *) s->pixels + y * s->pitch + x * s->format->BytesPerPixel;
+
+  switch (s->format->BytesPerPixel)
+  {
+    case 1:
+      return *p;
+    case 2:
+      return *(Uint16 *) p;
+    case 3:
+      if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
+        return p[0] << 16 | p[1] << 8 | p[2];
+      return p[0] | p[1] << 8 | p[2] << 16;
+    default:
+      return *(Uint32 *) p;
+  }
+}
+
+static int is_clear(SDL_Surface *s, int x, int y)
+{
+  Uint32 pixel = get_pixel(s, x, y);
+  Uint8 r, g, b, a;
+
+  if ((s->flags & SDL_SRCCOLORKEY) && pixel == s->format->colorkey)
+    return 1;
+
+  /* Alpha is ignored unless the sheet is blended */
+  if (!s->format->Amask || !(s->flags & SDL_SRCALPHA))
+    return 0;
+
+  SDL_GetRGBA(pixel, s->format, &r, &g, &b, &a);
+  return a == 0;
+}
+
+static void trim_frames(SPRITE *spr)
+{
+  SPRITE_FRAME *f;
+  int i, x, y, x1, y1, x2, y2;
+
+  if (!(spr->img->format->Amask && (spr->img->flags & SDL_SRCALPHA)) &&
+      !(spr->img->flags & SDL_SRCCOLORKEY))
+    return;
+
+  if (SDL_LockSurface(spr->img) < 0)
+    return;
+
+  for (i = 0; i < spr->nframes; i++)
+  {
+    f = &spr->frames[i];
+
+    /* Bounding box of the visible pixels */
+    x1 = spr->w;
+    y1 = spr->h;
+    x2 = y2 = -1;
+    for (y = 0; y < spr->h; y++)
+      for (x = 0; x < spr->w; x++)
+        if (!is_clear(spr->img, f->x + x, f->y + y))
+        {
+          if (x < x1) x1 = x;
+          if (x > x2) x2 = x;
+          if (y < y1) y1 = y;
+          if (y > y2) y2 = y;
+        }
+
+    if (x2 < 0)
+    {
+      f->tw = f->th = 0;
+      continue;
+    }
+
+    f->tx = x1;
+    f->ty = y1;
+    f->tw = x2 - x1 + 1;
+    f->th = y2 - y1 + 1;
+  }
+
+  SDL_UnlockSurface(spr->img);
+}
+
+#endif
+
+static void load_frame_meta(SPRITE *spr, const char *fn)
+{
+  char path[256], line[128];
+  int i, ax, ay, tx, ty, tw, th, n;
+  FILE *fp;
+
+  if (strlen(fn) + sizeof(".frames") > sizeof(path))
+    return;
+  sprintf(path, "%s.frames", fn);
+
+  /* Metadata is optional */
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return;
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    if (line[0] == '#')
+      continue;
+
+    n = sscanf(line, "%d %d %d %d %d %d %d", &i, &ax, &ay, &tx, &ty, &tw, &th);
+    if (n < 3 || i < 0 || i >= spr->nframes)
+      continue;
+
+    spr->frames[i].ax = ax;
+    spr->frames[i].ay = ay;
+
+    if (n == 7 && tx >= 0 && ty >= 0 && tw >= 0 && th >= 0 &&
+        tx + tw <= spr->w && ty + th <= spr->h)
+    {
+      spr->frames[i].tx = tx;
+      spr->frames[i].ty = ty;
+      spr->frames[i].tw = tw;
+      spr->frames[i].th = th;
+    }
+  }
+
+  fclose(fp);
+}
+
+#ifdef SDL_GFX
+
+/* Can the blit kernels draw this surface onto the screen? */
+static int is_direct(SDL_Surface *img)
+{
+  SDL_PixelFormat *fmt = img->format, *sfmt;
+
+  if (screen_dest == NULL)
+    return 0;
+  sfmt = screen_dest->format;
+
+  if (sfmt->BytesPerPixel != 4 || fmt->BytesPerPixel != 4 ||
+      fmt->Rmask != sfmt->Rmask || fmt->Gmask != sfmt->Gmask ||
+      fmt->Bmask != sfmt->Bmask)
+    return 0;
+
+  /* Blending needs alpha in the spare byte, not a surface alpha */
+  if (img->flags & SDL_SRCALPHA)
+    return fmt->Amask == ~(sfmt->Rmask | sfmt->Gmask | sfmt->Bmask);
+
+  return 1;
+}
+
+/* Convert a sheet to the screen layout with alpha in the spare byte */
+static SDL_Surface *screen_format(SDL_Surface *img)
+{
+  SDL_PixelFormat *sfmt;
+  SDL_Surface *conv;
+  int alpha;
+
+  if (screen_dest == NULL || screen_dest->format->BytesPerPixel != 4 ||
+      is_direct(img))
+    return img;
+  sfmt = screen_dest->format;
+
+  conv = SDL_CreateRGBSurface(SDL_SWSURFACE, img->w, img->h, 32,
+                              sfmt->Rmask, sfmt->Gmask, sfmt->Bmask,
+                              ~(sfmt->Rmask | sfmt->Gmask | sfmt->Bmask));
+  if (conv == NULL)
+    return img;
+
+  /* Copy alpha rather than blend, color keyed pixels stay clear */
+  alpha = img->flags & (SDL_SRCALPHA | SDL_SRCCOLORKEY);
+  SDL_FillRect(conv, NULL, 0);
+  SDL_SetAlpha(img, 0, 255);
+  SDL_BlitSurface(img, NULL, conv, NULL);
+  SDL_SetAlpha(conv, alpha ? SDL_SRCALPHA : 0, 255);
+
+  SDL_FreeSurface(img);
+  return conv;
+}
+
+/* Sheets from the asset pack use its mapped pixels, without a copy */
+static SDL_Surface *load_image(const char *fn)
+{
+  const struct pack_entry *e;
+  SDL_Surface *img;
+
+  e = find_pack_entry(fn);
+  if (e == NULL)
+  {
+    img = IMG_Load(fn);
+    return img ? screen_format(img) : NULL;
+  }
+
+  img = SDL_CreateRGBSurfaceFrom(pack_pixels(e), e->w, e->h, 32, e->pitch,
+                                 PACK_RMASK, PACK_GMASK, PACK_BMASK,
+                                 PACK_AMASK);
+  if (img != NULL)
+  {
+    SDL_SetAlpha(img, (e->flags & PACK_ALPHA) ? SDL_SRCALPHA : 0, 255);
+    img = screen_format(img);
+  }
+
+  return img;
+}
+
+#endif
+
+/* Load the sheet and build its frame table, spr->w and spr->h are set */
+static int load_sheet(SPRITE *spr, const char *fn)
+{
+#ifdef SDL_GFX
+
+  spr->img = load_image(fn);
+  if (spr->img == NULL)
+    return 0;
+
+  spr->nhsprites=(spr->img->w-1)/(spr->w+1);
+  spr->nvsprites=(spr->img->h-1)/(spr->h+1);
+
+  if (!init_frames(spr))
+  {
+    SDL_FreeSurface(spr->img);
+    return 0;
+  }
+
+  trim_frames(spr);
+  spr->direct = is_direct(spr->img);
+
+#else
+
+  if ((spr->img = (pngRawInfo *) malloc(sizeof(pngRawInfo))) == NULL)
+    return 0;
+
+  pngLoadRaw(fn, spr->img);
+
+  spr->nhsprites=(spr->img->Width-1)/(spr->w+1);
+  spr->nvsprites=(spr->img->Height-1)/(spr->h+1);
+
+  if (!init_frames(spr))
+  {
+    free(spr->img);
+    return 0;
+  }
+
+#endif
+
+  load_frame_meta(spr, fn);
+  METRIC_INC(MC_SPRITE_LOADS);
+
+  return 1;
+}
+
+static SPRITE *alloc_sprite(int w, int h)
 {
   SPRITE *spr;
 
-  spr = malloc(sizeof(SPRITE));
+  spr = calloc(1, sizeof(SPRITE));
   if (spr == NULL) return NULL;
 
   spr->w = w;
   spr->h = h;
+  spr->id = num_sheets++;
+  spr->state = SPRITE_READY;
+  spr->refs = 1;
 
-#ifdef SDL_GFX
+  return spr;
+}
 
-  spr->img = IMG_Load(fn);
-  if (spr->img == NULL)
+SPRITE* load_sprite(const char *fn, int w, int h)
+{
+  SPRITE *spr;
+
+  spr = alloc_sprite(w, h);
+  if (spr == NULL) return NULL;
+
+  if (!load_sheet(spr, fn))
   {
     free(spr);
     return NULL;
   }
 
-  spr->nhsprites=(spr->img->w-1)/(w+1);
-  spr->nvsprites=(spr->img->h-1)/(h+1);
+  return spr;
+}
+
+#ifdef SDL_GFX
+
+/*
+ * Asynchronous loading.  Requests are handed to one worker thread, which
+ * decodes the sheet and builds its tables, and come back on a completion
+ * list.  The main thread only looks at a sheet again after taking it off
+ * that list, so a loading sheet is never touched by two threads at once.
+ */
+
+typedef struct load_request
+{
+  SPRITE *spr;
+  char *fn;
+  int flags;
+  int ok;
+  struct load_request *next;
+} LOAD_REQUEST;
+
+static pthread_t loader;
+static int loader_running;
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t load_wanted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t load_done = PTHREAD_COND_INITIALIZER;
+static LOAD_REQUEST *pending, *pending_tail, *completed;
+
+static void *loader_main(void *arg)
+{
+  LOAD_REQUEST *req;
+
+  pthread_mutex_lock(&load_lock);
+  for (;;)
+  {
+    while (pending == NULL)
+      pthread_cond_wait(&load_wanted, &load_lock);
+
+    req = pending;
+    pending = req->next;
+    if (pending == NULL)
+      pending_tail = NULL;
+    pthread_mutex_unlock(&load_lock);
+
+    req->ok = load_sheet(req->spr, req->fn);
+    if (req->ok && (req->flags & SPRITE_PACKED))
+      pack_sprite(req->spr);
+
+    pthread_mutex_lock(&load_lock);
+    req->next = completed;
+    completed = req;
+    pthread_cond_broadcast(&load_done);
+  }
+
+  return NULL;
+}
+
+static int request_load(SPRITE *spr, const char *fn, int flags)
+{
+  LOAD_REQUEST *req;
+
+  if (!loader_running)
+  {
+    if (pthread_create(&loader, NULL, loader_main, NULL) != 0)
+      return 0;
+    pthread_detach(loader);
+    loader_running = 1;
+  }
+
+  req = malloc(sizeof(LOAD_REQUEST));
+  if (req == NULL) return 0;
+
+  req->fn = strdup(fn);
+  if (req->fn == NULL)
+  {
+    free(req);
+    return 0;
+  }
+  req->spr = spr;
+  req->flags = flags;
+  req->next = NULL;
+
+  pthread_mutex_lock(&load_lock);
+  if (pending_tail != NULL)
+    pending_tail->next = req;
+  else
+    pending = req;
+  pending_tail = req;
+  pthread_cond_signal(&load_wanted);
+  pthread_mutex_unlock(&load_lock);
+
+  return 1;
+}
+
+/* Take finished requests off the completion list, called with the lock */
+static void complete_loads(void)
+{
+  LOAD_REQUEST *req;
+
+  while ((req = completed) != NULL)
+  {
+    completed = req->next;
+
+    if (req->ok)
+      req->spr->state = SPRITE_READY;
+    else
+    {
+      fprintf(stderr, "Error -- Unable to load sprite: %s\n", req->fn);
+      req->spr->state = SPRITE_FAILED;
+    }
+
+    free(req->fn);
+    free(req);
+  }
+}
+
+void poll_sprites(void)
+{
+  if (!loader_running)
+    return;
+
+  pthread_mutex_lock(&load_lock);
+  complete_loads();
+  pthread_mutex_unlock(&load_lock);
+}
+
+static void wait_sprite(SPRITE *spr)
+{
+  pthread_mutex_lock(&load_lock);
+  for (;;)
+  {
+    complete_loads();
+    if (spr->state != SPRITE_LOADING)
+      break;
+    pthread_cond_wait(&load_done, &load_lock);
+  }
+  pthread_mutex_unlock(&load_lock);
+}
 
 #else
 
-  if ((spr->img = (pngRawInfo *) malloc(sizeof(pngRawInfo))) == NULL) {
+void poll_sprites(void)
+{
+}
+
+#endif
+
+/*
+ * Sheets loaded by name are shared.  The cache holds one reference, so a
+ * sheet stays loaded once requested and prefetching it keeps it around
+ * for later.
+ */
+
+typedef struct
+{
+  char *fn;
+  SPRITE *spr;
+} CACHED_SPRITE;
+
+static CACHED_SPRITE *cache;
+static int num_cached, max_cached;
+
+SPRITE* get_sprite(const char *fn, int w, int h, int flags)
+{
+  CACHED_SPRITE *c;
+  SPRITE *spr;
+  int i;
+
+  for (i = 0; i < num_cached; i++)
+    if (cache[i].spr->w == w && cache[i].spr->h == h &&
+        strcmp(cache[i].fn, fn) == 0)
+      break;
+
+  if (i < num_cached)
+    spr = cache[i].spr;
+  else
+  {
+    if (num_cached == max_cached)
+    {
+      int n = max_cached ? max_cached * 2 : 16;
+
+      c = realloc(cache, sizeof(CACHED_SPRITE) * n);
+      if (c == NULL) return NULL;
+      cache = c;
+      max_cached = n;
+    }
+
+    spr = alloc_sprite(w, h);
+    if (spr == NULL) return NULL;
+
+    c = &cache[num_cached];
+    c->fn = strdup(fn);
+    if (c->fn == NULL)
+    {
+      free(spr);
+      return NULL;
+    }
+    c->spr = spr;
+    spr->cached = 1;
+    spr->state = SPRITE_LOADING;
+
+#ifdef SDL_GFX
+    if ((flags & SPRITE_ASYNC) && request_load(spr, fn, flags))
+    {
+      num_cached++;
+      spr->refs++;
+      return spr;
+    }
+#endif
+
+    if (!load_sheet(spr, fn))
+    {
+      free(c->fn);
+      free(spr);
+      return NULL;
+    }
+    if (flags & SPRITE_PACKED)
+      pack_sprite(spr);
+    spr->state = SPRITE_READY;
+    num_cached++;
+  }
+
+#ifdef SDL_GFX
+  if (!(flags & SPRITE_ASYNC) && spr->state == SPRITE_LOADING)
+    wait_sprite(spr);
+#endif
+
+  /* Only asynchronous callers are given a sheet that failed */
+  if (!(flags & SPRITE_ASYNC) && spr->state == SPRITE_FAILED)
+    return NULL;
+
+  spr->refs++;
+  return spr;
+}
+
+void prefetch_sprite(const char *fn, int w, int h, int flags)
+{
+  SPRITE *spr;
+
+  spr = get_sprite(fn, w, h, flags | SPRITE_ASYNC);
+  if (spr != NULL)
+    free_sprite(spr);
+}
+
+SPRITE* new_sprite(int w, int h, SPRITE *like)
+{
+#ifdef SDL_GFX
+  SPRITE *spr;
+  SDL_PixelFormat *fmt = like->img->format;
+
+  spr = alloc_sprite(w, h);
+  if (spr == NULL) return NULL;
+
+  spr->nhsprites = 1;
+  spr->nvsprites = 1;
+
+  /* One frame with the usual one pixel border, fully transparent */
+  spr->img = SDL_CreateRGBSurface(SDL_SWSURFACE, w + 2, h + 2,
+                                  fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask,
+                                  fmt->Bmask, fmt->Amask);
+  if (spr->img == NULL)
+  {
     free(spr);
     return NULL;
   }
 
-  pngLoadRaw(fn, spr->img);
+  if (!init_frames(spr))
+  {
+    SDL_FreeSurface(spr->img);
+    free(spr);
+    return NULL;
+  }
 
-  spr->nhsprites=(spr->img->Width-1)/(w+1);
-  spr->nvsprites=(spr->img->Height-1)/(h+1);
+  SDL_FillRect(spr->img, NULL, 0);
+  SDL_SetAlpha(spr->img, like->img->flags & SDL_SRCALPHA,
+               like->img->format->alpha);
+  spr->direct = is_direct(spr->img);
 
+  return spr;
+#else
+  /* Rendering into sprites is not supported with OpenGL */
+  return NULL;
 #endif
+}
 
-  return spr;
+void set_sprite_target(SPRITE *spr, int blend)
+{
+#ifdef SDL_GFX
+  target = spr;
+  target_blend = blend;
+  dest = spr ? spr->img : screen_dest;
+#endif
 }
 
 void free_sprite(SPRITE *spr)
 {
+  /* Shared sheets are kept by the cache */
+  if (--spr->refs > 0)
+    return;
 
 #ifdef SDL_GFX
   SDL_FreeSurface(spr->img);
+  free(spr->spans);
+  free(spr->span_start);
 #else
   free(spr->img);
 #endif
+  free(spr->frames);
   free(spr);
 }
 
 #ifdef SDL_GFX
 
+/*
+ * Every row of a packed frame is a count of runs followed by the runs.  A
+ * run is a header word with the x offset in the upper half and the length
+ * in the lower bits, then one pixel per opaque pixel or a pixel and an
+ * alpha value per translucent pixel.
+ */
+
+#define SPAN_BLEND	0x8000
+#define SPAN_COUNT	0x7fff
+
+static int pack_frame(SPRITE *spr, SPRITE_FRAME *f, Uint32 *out)
+{
+  SDL_PixelFormat *fmt = spr->img->format;
+  int x, y, n, run, size, blend;
+  Uint32 *rows;
+  Uint8 r, g, b, a;
+
+  size = 0;
+  for (y = 0; y < f->th; y++)
+  {
+    rows = out ? out + size : NULL;
+    size++;
+    n = 0;
+
+    for (x = 0; x < f->tw; x = run)
+    {
+      if (is_clear(spr->img, f->x + f->tx + x, f->y + f->ty + y))
+      {
+        run = x + 1;
+        continue;
+      }
+
+      /* Collect pixels of the same kind */
+      SDL_GetRGBA(get_pixel(spr->img, f->x + f->tx + x, f->y + f->ty + y),
+                  fmt, &r, &g, &b, &a);
+      blend = a != 255 && (spr->img->flags & SDL_SRCALPHA);
+      for (run = x; run < f->tw && run - x < SPAN_COUNT; run++)
+      {
+        if (is_clear(spr->img, f->x + f->tx + run, f->y + f->ty + y))
+          break;
+        SDL_GetRGBA(get_pixel(spr->img, f->x + f->tx + run,
+                              f->y + f->ty + y), fmt, &r, &g, &b, &a);
+        if ((a != 255 && (spr->img->flags & SDL_SRCALPHA)) != blend)
+          break;
+
+        if (out)
+        {
+          out[size + 1 + (run - x) * (blend ? 2 : 1)] =
+            SDL_MapRGB(screen_dest->format, r, g, b);
+          if (blend)
+            out[size + 2 + (run - x) * 2] = a;
+        }
+      }
+
+      if (out)
+        out[size] = (Uint32) x << 16 | (blend ? SPAN_BLEND : 0) | (run - x);
+      size += 1 + (run - x) * (blend ? 2 : 1);
+      n++;
+    }
+
+    if (rows)
+      *rows = n;
+  }
+
+  return size;
+}
+
+int pack_sprite(SPRITE *spr)
+{
+  Uint32 flags = spr->img->flags;
+  int i, size;
+
+  /* The span blitter writes 32 bit pixels with 8 bit channels */
+  if (screen_dest == NULL || screen_dest->format->BytesPerPixel != 4 ||
+      spr->spans != NULL)
+    return 0;
+
+  /* Only per pixel alpha or a color key, no surface alpha */
+  if ((flags & SDL_SRCALPHA) ? !spr->img->format->Amask :
+      !(flags & SDL_SRCCOLORKEY))
+    return 0;
+
+  if (SDL_LockSurface(spr->img) < 0)
+    return 0;
+
+  spr->span_start = malloc(sizeof(int) * (spr->nframes ? spr->nframes : 1));
+  if (spr->span_start == NULL)
+  {
+    SDL_UnlockSurface(spr->img);
+    return 0;
+  }
+
+  size = 0;
+  for (i = 0; i < spr->nframes; i++)
+  {
+    spr->span_start[i] = size;
+    size += pack_frame(spr, &spr->frames[i], NULL);
+  }
+
+  spr->spans = malloc(sizeof(Uint32) * (size ? size : 1));
+  if (spr->spans == NULL)
+  {
+    free(spr->span_start);
+    spr->span_start = NULL;
+    SDL_UnlockSurface(spr->img);
+    return 0;
+  }
+
+  for (i = 0; i < spr->nframes; i++)
+    pack_frame(spr, &spr->frames[i], spr->spans + spr->span_start[i]);
+
+  SDL_UnlockSurface(spr->img);
+  return 1;
+}
+
+static void draw_spans(const Uint32 *p, int h, int x, int y,
+                       int clip_x, int clip_y, int clip_w, int clip_h)
+{
+  Uint32 *line;
+  int row, n, rx, count, x0, x1, i;
+  int lock = !dest_locked && SDL_MUSTLOCK(dest);
+  const Uint32 *data;
+  unsigned long pixels = 0;
+
+  /* Never write outside the screen */
+  if (clip_x < 0) clip_x = 0;
+  if (clip_y < 0) clip_y = 0;
+  if (clip_w > dest->w) clip_w = dest->w;
+  if (clip_h > dest->h) clip_h = dest->h;
+
+  if (lock && SDL_LockSurface(dest) < 0)
+    return;
+
+  for (row = 0; row < h; row++)
+  {
+    line = (Uint32 *) ((Uint8 *) dest->pixels + (y + row) * dest->pitch);
+    n = *p++;
+
+    /* Rows outside the clipping box are only skipped */
+    if (y + row < clip_y || y + row >= clip_h)
+    {
+      while (n--)
+        p += 1 + (*p & SPAN_COUNT) * ((*p & SPAN_BLEND) ? 2 : 1);
+      continue;
+    }
+
+    while (n--)
+    {
+      rx = x + (*p >> 16);
+      count = *p & SPAN_COUNT;
+      data = p + 1;
+
+      if (*p & SPAN_BLEND)
+      {
+        p += 1 + count * 2;
+
+        x0 = rx < clip_x ? clip_x : rx;
+        x1 = rx + count > clip_w ? clip_w : rx + count;
+        for (i = x0; i < x1; i++)
+          line[i] = blend_pixel(data[(i - rx) * 2], line[i],
+                                data[(i - rx) * 2 + 1]);
+      }
+      else
+      {
+        p += 1 + count;
+
+        x0 = rx < clip_x ? clip_x : rx;
+        x1 = rx + count > clip_w ? clip_w : rx + count;
+        if (x0 < x1)
+          memcpy(line + x0, data + (x0 - rx), (x1 - x0) * sizeof(Uint32));
+      }
+
+      if (x0 < x1)
+        pixels += x1 - x0;
+    }
+  }
+
+  if (lock)
+    SDL_UnlockSurface(dest);
+
+  METRIC_ADD(MC_SPAN_PIXELS, pixels);
+}
+
+/* Draw a clipped rectangle of a direct sheet onto the screen */
+static void draw_direct(SDL_Surface *img, SDL_Rect *src, int x, int y)
+{
+  int lock = !dest_locked && SDL_MUSTLOCK(dest);
+  Uint32 *d;
+  const Uint32 *s;
+  int w = src->w, h = src->h;
+
+  /* Never write outside the screen */
+  if (x < 0) { src->x -= x; w += x; x = 0; }
+  if (y < 0) { src->y -= y; h += y; y = 0; }
+  if (x + w > dest->w) w = dest->w - x;
+  if (y + h > dest->h) h = dest->h - y;
+  if (w <= 0 || h <= 0)
+    return;
+
+  if (lock && SDL_LockSurface(dest) < 0)
+    return;
+
+  d = (Uint32 *) ((Uint8 *) dest->pixels + y * dest->pitch) + x;
+  s = (const Uint32 *) ((const Uint8 *) img->pixels + src->y * img->pitch) +
+      src->x;
+  if (img->flags & SDL_SRCALPHA)
+    blit_blend32(d, dest->pitch, s, img->pitch, w, h, img->format->Ashift);
+  else if (img->flags & SDL_SRCCOLORKEY)
+    blit_key32(d, dest->pitch, s, img->pitch, w, h, img->format->colorkey,
+               img->format->Rmask | img->format->Gmask | img->format->Bmask);
+  else
+    blit_copy32(d, dest->pitch, s, img->pitch, w, h);
+
+  if (lock)
+    SDL_UnlockSurface(dest);
+}
+
+static void draw_placeholder(int x, int y, SPRITE *spr,
+                             int clip_x, int clip_y, int clip_w, int clip_h)
+{
+  SDL_Rect r;
+  int x1, y1;
+
+  x1 = x + spr->w < clip_w ? x + spr->w : clip_w;
+  y1 = y + spr->h < clip_h ? y + spr->h : clip_h;
+  if (x < clip_x) x = clip_x;
+  if (y < clip_y) y = clip_y;
+  if (x >= x1 || y >= y1)
+    return;
+
+  r.x = x + (target != NULL);
+  r.y = y + (target != NULL);
+  r.w = x1 - x;
+  r.h = y1 - y;
+  SDL_FillRect(dest, &r, SDL_MapRGB(dest->format, 48, 48, 48));
+}
+
 void draw_sprite(int x, int y,
 		 int index, SPRITE *spr,
 		 int clip_x, int clip_y, int clip_w, int clip_h)
 {
-  int tx,ty,sx,sy;
+  SPRITE_FRAME *f;
+  int tx,ty,fw,fh;
   int bx,by,bw,bh;
   SDL_Rect dest_rect, src_rect;
 
-  /* Cache and precalculate variables */
-  tx=x;
-  ty=y;
+  /* Sheets still loading are drawn as a box */
+  if (spr->state != SPRITE_READY)
+  {
+    draw_placeholder(x, y, spr, clip_x, clip_y, clip_w, clip_h);
+    return;
+  }
+
+  /* Frames outside the sheet are not drawn */
+  if(index<0||index>=spr->nframes)
+    return;
+  f=&spr->frames[index];
+
+  /* Blended blits only need the visible part of the frame, raw copies
+     into a target need all of it to clear the old pixels */
+  tx=x-f->ax;
+  ty=y-f->ay;
   bx=0;
   by=0;
-  bw=spr->w;
-  bh=spr->h;
+  if (target == NULL || target_blend)
+  {
+    bx=f->tx;
+    by=f->ty;
+    fw=f->tw;
+    fh=f->th;
+  }
+  else
+  {
+    fw=spr->w;
+    fh=spr->h;
+  }
 
-  /* Test if sprite is complete outside clipping box */
-  if((tx+spr->w<=clip_x)||(tx>=clip_w)||(ty+spr->h<=clip_y)||(ty>=clip_h))
+  /* Nothing visible in this frame */
+  if(fw<=0||fh<=0)
     return;
 
-  /* Get starting position in pixels of indexed tile */
-  sx=1+(index%spr->nhsprites)*(spr->w+1);
-  sy=1+(index/spr->nhsprites)*(spr->h+1);
+  /* Cache and precalculate variables */
+  tx+=bx;
+  ty+=by;
+  bw=fw;
+  bh=fh;
 
-  /* Test if clipping is needed */
-  if( tx>=clip_x || tx+spr->w<=clip_w ||
-      ty>=clip_y || ty+spr->h<=clip_h )
-  {
-    /* x left of clipping box */
-    if(tx<clip_x)
-    {
-      bx=clip_x-tx;
-      bw=spr->w-bx;
-      tx=clip_x;
-    }
+  /* Test if sprite is complete outside clipping box, which may be empty */
+  if((tx+fw<=clip_x)||(tx>=clip_w)||(ty+fh<=clip_y)||(ty>=clip_h)||
+     (clip_x>=clip_w)||(clip_y>=clip_h))
+    return;
 
-    /* x+w right of clipping box */
-    else if(tx+spr->w>clip_w)
-    {
-      bx=0;
-      bw=clip_w-tx;
-    }
+  /* Packed frames go to the screen through the span blitter */
+  if (target == NULL && spr->spans != NULL)
+  {
+    draw_spans(spr->spans + spr->span_start[index], fh, tx, ty,
+               clip_x, clip_y, clip_w, clip_h);
+    METRIC_INC(MC_BLITS);
+    return;
+  }
 
-    /* y over of clipping box */
-    if(ty<clip_y)
-    {
-      by=clip_y-ty;
-      bh=spr->h-by;
-      ty=clip_y;
-    }
+  /* Clip each side, a sprite may cross both edges of the box */
+  if(tx<clip_x)
+  {
+    bx+=clip_x-tx;
+    bw-=clip_x-tx;
+    tx=clip_x;
+  }
+  if(tx+bw>clip_w)
+    bw=clip_w-tx;
 
-    /* y+h under clipping box */
-    else if(ty+spr->h>clip_h)
-    {
-      by=0;
-      bh=clip_h-ty;
-    }
+  if(ty<clip_y)
+  {
+    by+=clip_y-ty;
+    bh-=clip_y-ty;
+    ty=clip_y;
   }
+  if(ty+bh>clip_h)
+    bh=clip_h-ty;
 
   /* Calculate rects for SDL blitter */
   dest_rect.x = tx;
   dest_rect.y = ty;
 
-  src_rect.x = sx+bx;
-  src_rect.y = sy+by;
+  src_rect.x = f->x+bx;
+  src_rect.y = f->y+by;
   src_rect.w = bw;
   src_rect.h = bh;
 
   /* Draw sprite */
-  SDL_BlitSurface(spr->img, &src_rect, dest, &dest_rect);
+  if (target != NULL && !target_blend)
+  {
+    Uint32 flags = spr->img->flags & SDL_SRCALPHA;
+    Uint8 alpha = spr->img->format->alpha;
+
+    /* Copy pixels and alpha unblended into the frame of the target */
+    dest_rect.x++;
+    dest_rect.y++;
+    SDL_SetAlpha(spr->img, 0, alpha);
+    SDL_BlitSurface(spr->img, &src_rect, dest, &dest_rect);
+    SDL_SetAlpha(spr->img, flags, alpha);
+  }
+  else if (target != NULL)
+  {
+    /* Blend into the frame of the target, its alpha is kept */
+    dest_rect.x++;
+    dest_rect.y++;
+    SDL_BlitSurface(spr->img, &src_rect, dest, &dest_rect);
+  }
+  else if (spr->direct)
+    draw_direct(spr->img, &src_rect, tx, ty);
+  else
+    SDL_BlitSurface(spr->img, &src_rect, dest, &dest_rect);
+  METRIC_INC(MC_BLITS);
+}
+
+void queue_sprite(int layer, int x, int y,
+		  int index, SPRITE *spr,
+		  int clip_x, int clip_y, int clip_w, int clip_h)
+{
+  SPRITE_CMD *cmd;
+
+  /* Drawing into sprites is never deferred */
+  if (target != NULL)
+  {
+    draw_sprite(x, y, index, spr, clip_x, clip_y, clip_w, clip_h);
+    return;
+  }
+
+  if (num_cmds == max_cmds)
+  {
+    int n = max_cmds ? max_cmds * 2 : 1024;
+
+    cmd = realloc(cmds, sizeof(SPRITE_CMD) * n);
+    if (cmd == NULL)
+    {
+      draw_sprite(x, y, index, spr, clip_x, clip_y, clip_w, clip_h);
+      return;
+    }
+
+    cmds = cmd;
+    max_cmds = n;
+  }
+
+  cmd = &cmds[num_cmds];
+  cmd->key = ((unsigned long long) layer << 56) | (unsigned long long) num_cmds;
+  if (layer != LAYER_ACTORS)
+    cmd->key |= (unsigned long long) (spr->id & 0xffffff) << 32;
+  cmd->spr = spr;
+  cmd->index = index;
+  cmd->x = x;
+  cmd->y = y;
+  cmd->clip_x = clip_x;
+  cmd->clip_y = clip_y;
+  cmd->clip_w = clip_w;
+  cmd->clip_h = clip_h;
+  num_cmds++;
+}
+
+static int compare_cmds(const void *a, const void *b)
+{
+  const SPRITE_CMD *ca = a, *cb = b;
+
+  return ca->key < cb->key ? -1 : ca->key > cb->key;
+}
+
+/* Draw the whole list clipped to the rows of one band */
+static void draw_band(int band)
+{
+  SPRITE_CMD *cmd, *end;
+  int y0, y1;
+
+  y0 = band * dest->h / num_bands;
+  y1 = (band + 1) * dest->h / num_bands;
+
+  for (cmd = cmds, end = cmds + num_cmds; cmd < end; cmd++)
+    draw_sprite(cmd->x, cmd->y, cmd->index, cmd->spr, cmd->clip_x,
+                cmd->clip_y > y0 ? cmd->clip_y : y0, cmd->clip_w,
+                cmd->clip_h < y1 ? cmd->clip_h : y1);
+}
+
+static void *band_main(void *arg)
+{
+  int band = (int) (long) arg;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&band_lock);
+  for (;;)
+  {
+    while (band_frame == seen)
+      pthread_cond_wait(&band_start, &band_lock);
+    seen = band_frame;
+
+    /* Bands beyond the current count sit this frame out */
+    if (band < num_bands)
+    {
+      pthread_mutex_unlock(&band_lock);
+      draw_band(band);
+      pthread_mutex_lock(&band_lock);
+
+      if (--bands_left == 0)
+        pthread_cond_signal(&band_done);
+    }
+  }
+
+  return NULL;
+}
+
+void set_sprite_bands(int n)
+{
+  char *s;
+
+  /* Zero picks one band per core, EDOM_BANDS overrides the choice */
+  if (n <= 0)
+  {
+    s = getenv("EDOM_BANDS");
+    n = s ? atoi(s) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  if (n > MAX_BANDS)
+    n = MAX_BANDS;
+  if (screen_dest != NULL && n > screen_dest->h / MIN_BAND_H)
+    n = screen_dest->h / MIN_BAND_H;
+  if (n < 1)
+    n = 1;
+
+  /* Workers are started once and kept for later frames */
+  pthread_mutex_lock(&band_lock);
+  while (band_workers < n - 1)
+  {
+    if (pthread_create(&band_threads[band_workers], NULL, band_main,
+                       (void *) (long) (band_workers + 1)) != 0)
+      break;
+    pthread_detach(band_threads[band_workers]);
+    band_workers++;
+  }
+  num_bands = band_workers + 1 < n ? band_workers + 1 : n;
+  pthread_mutex_unlock(&band_lock);
+}
+
+/* Can every queued sprite be drawn without SDL? */
+static int can_composite(void)
+{
+  SPRITE_CMD *cmd, *end;
+
+  if (dest != screen_dest || dest->format->BytesPerPixel != 4)
+    return 0;
+
+  for (cmd = cmds, end = cmds + num_cmds; cmd < end; cmd++)
+    if (cmd->spr->state != SPRITE_READY ||
+        (!cmd->spr->direct && cmd->spr->spans == NULL))
+      return 0;
+
+  return 1;
+}
+
+void flush_sprites(void)
+{
+  SPRITE_CMD *cmd, *end;
+
+  /* Sheets loaded since the last frame are drawn from now on */
+  poll_sprites();
+
+  qsort(cmds, num_cmds, sizeof(SPRITE_CMD), compare_cmds);
+
+  if (num_bands > 1 && can_composite() &&
+      (!SDL_MUSTLOCK(dest) || SDL_LockSurface(dest) >= 0))
+  {
+    dest_locked = 1;
+
+    pthread_mutex_lock(&band_lock);
+    bands_left = num_bands - 1;
+    band_frame++;
+    pthread_cond_broadcast(&band_start);
+    pthread_mutex_unlock(&band_lock);
+
+    draw_band(0);
+
+    /* Join the bands before the screen is flipped */
+    pthread_mutex_lock(&band_lock);
+    while (bands_left > 0)
+      pthread_cond_wait(&band_done, &band_lock);
+    pthread_mutex_unlock(&band_lock);
+
+    dest_locked = 0;
+    if (SDL_MUSTLOCK(dest))
+      SDL_UnlockSurface(dest);
+  }
+  else
+  {
+    for (cmd = cmds, end = cmds + num_cmds; cmd < end; cmd++)
+      draw_sprite(cmd->x, cmd->y, cmd->index, cmd->spr,
+                  cmd->clip_x, cmd->clip_y, cmd->clip_w, cmd->clip_h);
+  }
+
+  num_cmds = 0;
 }
 
 #else
 
+int pack_sprite(SPRITE *spr)
+{
+  /* glDrawPixels has no use for runs */
+  return 0;
+}
+
 void draw_sprite(int x,int y,
 		 int index,SPRITE *spr,
 		 int clip_x,int clip_y,int clip_w,int clip_h)
 {
+  SPRITE_FRAME *f;
   int w, h;
   int tx,ty,sx,sy;
   int bx,by,bw,bh;
-  int nhsprites,nvsprites;
+
+  /* Frames outside the sheet are not drawn */
+  if(index<0||index>=spr->nframes)
+    return;
+  f=&spr->frames[index];
 
   /* Store width and height */
   w = spr->w;
   h = spr->h;
-  nhsprites = spr->nhsprites;
-  nvsprites = spr->nvsprites;
 
   /* Cache and precalculate variables */
-  tx=x;
-  ty=window_height-h-y; /* invert y-axis */
+  tx=x-f->ax;
+  ty=window_height-h-(y-f->ay); /* invert y-axis */
   bx=0;
   by=0;
   bw=w;
@@ -205,8 +1317,8 @@ void draw_sprite(int x,int y,
     return;
 
   /* Get statring position in pixels of indexed tile */
-  sx=1+(index%nhsprites)*(w+1);
-  sy=nvsprites*h-(index/nhsprites)*(h+1)-1;
+  sx=f->x;
+  sy=f->y;
 
   /* Test if no clipping is needed */
   if((tx>=clip_x&&tx+w<=clip_w)&&(ty>=clip_y&&ty+h<=clip_h))
@@ -221,6 +1333,7 @@ void draw_sprite(int x,int y,
 
     /* Draw tile */
     glDrawPixels(bw,bh,GL_RGBA,GL_UNSIGNED_BYTE,spr->img->Data);
+    METRIC_INC(MC_BLITS);
 
     /* Done */
     return;
@@ -268,7 +1381,24 @@ void draw_sprite(int x,int y,
 
   /* Draw tile */
   glDrawPixels(bw,bh,GL_RGBA,GL_UNSIGNED_BYTE,spr->img->Data);
+  METRIC_INC(MC_BLITS);
 }
 
-#endif
+void queue_sprite(int layer, int x, int y,
+		  int index, SPRITE *spr,
+		  int clip_x, int clip_y, int clip_w, int clip_h)
+{
+  /* No draw list with OpenGL */
+  draw_sprite(x, y, index, spr, clip_x, clip_y, clip_w, clip_h);
+}
 
+void flush_sprites(void)
+{
+}
+
+void set_sprite_bands(int n)
+{
+  /* OpenGL draws from one thread */
+}
+
+#endif
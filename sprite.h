@@ -36,13 +36,68 @@
 #include "load_png.h"
 #endif
 
+/* Layers of the per-frame draw list, drawn from bottom to top */
+enum sprite_layer
+{
+  LAYER_MAP,
+  LAYER_ACTORS,
+  LAYER_PLAYER,
+  LAYER_PANEL,
+  LAYER_TEXT,
+  MAX_LAYER
+};
+
+/* Flags for get_sprite */
+#define SPRITE_ASYNC	1	/* Return at once, load on the loader thread */
+#define SPRITE_PACKED	2	/* Pack into runs, see pack_sprite */
+
+enum sprite_state
+{
+  SPRITE_LOADING,
+  SPRITE_READY,
+  SPRITE_FAILED
+};
+
+typedef struct
+{
+  /* Position of the frame in the sheet */
+  short x, y;
+
+  /* Bounds of the visible pixels, relative to the frame */
+  short tx, ty, tw, th;
+
+  /* Anchor point, subtracted from the draw position */
+  short ax, ay;
+} SPRITE_FRAME;
+
 typedef struct
 {
   int w, h;
   int nvsprites, nhsprites;
 
+  /* Sheet number, used to group draws from the same sheet */
+  int id;
+
+  /* A placeholder is drawn until the sheet is ready */
+  enum sprite_state state;
+
+  /* References, and whether the sheet is shared through the cache */
+  int refs;
+  int cached;
+
+  /* Source rectangle, trimmed bounds and anchor of every frame */
+  int nframes;
+  SPRITE_FRAME *frames;
+
 #ifdef SDL_GFX
   SDL_Surface *img;
+
+  /* Runs of visible pixels in screen format, see pack_sprite */
+  Uint32 *spans;
+  int *span_start;
+
+  /* Pixels are in the screen layout and go through the blit kernels */
+  int direct;
 #else
   pngRawInfo *img;
 #endif
@@ -54,10 +109,21 @@ extern int window_height;
 
 extern void set_sprite_context(void *cx, int w, int h);
 extern SPRITE* load_sprite(const char *fn, int w, int h);
+extern SPRITE* get_sprite(const char *fn, int w, int h, int flags);
+extern void prefetch_sprite(const char *fn, int w, int h, int flags);
+extern void poll_sprites(void);
+extern SPRITE* new_sprite(int w, int h, SPRITE *like);
+extern int pack_sprite(SPRITE *spr);
+extern void set_sprite_target(SPRITE *spr, int blend);
 extern void free_sprite(SPRITE *spr);
 extern void draw_sprite(int x, int y,
 			int index, SPRITE *spr,
                      	int clip_x, int clip_y, int clip_w, int clip_h);
+extern void queue_sprite(int layer, int x, int y,
+			 int index, SPRITE *spr,
+			 int clip_x, int clip_y, int clip_w, int clip_h);
+extern void flush_sprites(void);
+extern void set_sprite_bands(int n);
 
 #endif
 
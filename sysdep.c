@@ -25,14 +25,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
-#include "main.h"
+#include "sysdep.h"
+#include "metrics.h"
 
 
 /*
- * Prototypes.
+ * Local variables.
+ *
+ * NOTE: The generator state is kept per thread so that the offline tools
+ *       can generate levels in parallel.
  */
 
-void initialize_colors(void);
+static __thread rand_type rand_seed = 1;
+
+
+
+/*
+ * Local functions.
+ */
+
+static rand_type next_rand(void)
+{
+  rand_type x = rand_seed;
+
+  /* Marsaglia's xorshift generator. */
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return (rand_seed = x);
+}
 
 
 
@@ -42,7 +64,41 @@ void initialize_colors(void);
 
 void init_rand(void)
 {
-  srandom(time(NULL));
+  seed_rand((rand_type) time(NULL));
+}
+
+
+
+/*
+ * Seed the random number generator.  Similar seeds are scrambled so that
+ * they still produce unrelated sequences.
+ */
+
+void seed_rand(rand_type seed)
+{
+  seed ^= seed >> 16;
+  seed *= 0x85ebca6bU;
+  seed ^= seed >> 13;
+  seed *= 0xc2b2ae35U;
+  seed ^= seed >> 16;
+
+  rand_seed = seed ? seed : 1;
+}
+
+
+
+/*
+ * Save and restore the exact generator state.
+ */
+
+rand_type get_rand_state(void)
+{
+  return rand_seed;
+}
+
+void set_rand_state(rand_type state)
+{
+  rand_seed = state ? state : 1;
 }
 
 
@@ -53,7 +109,9 @@ void init_rand(void)
 
 byte rand_byte(byte max)
 {
-  return (byte) (random() % max);
+  METRIC_INC(MC_RAND_CALLS);
+
+  return (byte) (next_rand() % max);
 }
 
 
@@ -63,7 +121,9 @@ byte rand_byte(byte max)
 
 uint16 rand_int(uint16 max)
 {
-  return (uint16) (random() % max);
+  METRIC_INC(MC_RAND_CALLS);
+
+  return (uint16) (next_rand() % max);
 }
 
 
@@ -73,9 +133,7 @@ uint16 rand_int(uint16 max)
 
 uint32 rand_long(uint32 max)
 {
-  return (uint32) (random() % max);
-}
-
-
-
+  METRIC_INC(MC_RAND_CALLS);
 
+  return (uint32) (next_rand() % max);
+}
@@ -80,5 +80,8 @@ uint16 rand_int(uint16);
 uint32 rand_long(uint32);
 
 void init_rand(void);
+void seed_rand(rand_type);
+rand_type get_rand_state(void);
+void set_rand_state(rand_type);
 
 #endif
@@ -0,0 +1,192 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * validate.c -- level connectivity checks
+ *
+ * The open cells of a level are kept as one 64 bit mask per map column.
+ * A flood fill from the upward stairs spreads along a column with a
+ * logarithmic (Kogge-Stone) fill and across columns through a worklist
+ * of columns that may still grow, so a whole level is checked with a few
+ * thousand word operations.
+ */
+
+#include <string.h>
+
+#include "validate.h"
+
+#define BYTES(c)  (0x0101010101010101ULL * (uint8_t) (c))
+#define HIGHS     BYTES(0x80)
+#define LOWS      BYTES(0x7f)
+
+const char *level_fault_names[MAX_LEVEL_FAULT] =
+{
+  "ok",
+  "shared_stairs",
+  "stairs_unreachable",
+  "disconnected"
+};
+
+/* Set the high bit of every byte in 'v' that equals 'c' */
+static uint64_t match_bytes(uint64_t v, byte c)
+{
+  uint64_t x = v ^ BYTES(c);
+
+  return ~(((x & LOWS) + LOWS) | x) & HIGHS;
+}
+
+/* Gather the high bits of the eight bytes in 'v' into one byte */
+static uint64_t gather_bytes(uint64_t v)
+{
+  return ((v >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+/*
+ * One bit per cell of a map column that equals 'c', built eight cells at
+ * a time.
+ */
+
+uint64_t match_column(const byte *col, byte c)
+{
+  uint64_t mask = 0, v;
+  int y;
+
+  for (y = 0; y + 8 <= MAP_H; y += 8) {
+    memcpy(&v, col + y, sizeof(v));
+    mask |= gather_bytes(match_bytes(v, c)) << y;
+  }
+
+  for (; y < MAP_H; y++)
+    mask |= (uint64_t) (col[y] == c) << y;
+
+  return mask;
+}
+
+/* One bit per passable cell of a map column */
+static uint64_t column_mask(const byte *col)
+{
+  return ~(match_column(col, ROCK) | match_column(col, LOCKED_DOOR)) &
+         COLUMN_BITS;
+}
+
+/* Spread the bits in 'r' along the runs of set bits in 'p' */
+static uint64_t fill_column(uint64_t r, uint64_t p)
+{
+  uint64_t gu = r, gd = r, pu = p, pd = p;
+  int i;
+
+  for (i = 1; i < 64; i <<= 1) {
+    gu |= pu & (gu << i);
+    pu &= pu << i;
+    gd |= pd & (gd >> i);
+    pd &= pd >> i;
+  }
+
+  return gu | gd;
+}
+
+/*
+ * Check that both stairways are reachable from each other and that no part
+ * of the level is cut off.
+ */
+
+enum level_fault validate_level(const struct level *lv, byte depth,
+                                byte map[MAP_W][MAP_H])
+{
+  uint64_t open[MAP_W], reach[MAP_W], start, r;
+  BOOL down = depth < MAX_DUNGEON_LEVEL - 1, queued[MAP_W];
+  int x, cols[MAP_W], n = 0;
+
+  if (down && lv->stxu == lv->stxd && lv->styu == lv->styd)
+    return LEVEL_SHARED_STAIRS;
+
+  memset(reach, 0, sizeof(reach));
+  memset(queued, 0, sizeof(queued));
+
+  for (x = 0; x < MAP_W; x++)
+    open[x] = column_mask(map[x]);
+
+  start = (uint64_t) 1 << lv->styu;
+  cols[n++] = lv->stxu;
+  queued[lv->stxu] = TRUE;
+
+  while (n) {
+
+    x = cols[--n];
+    queued[x] = FALSE;
+
+    r = reach[x];
+    if (x == lv->stxu)
+      r |= start;
+    if (x > 0)
+      r |= reach[x - 1] & open[x];
+    if (x < MAP_W - 1)
+      r |= reach[x + 1] & open[x];
+
+    r = fill_column(r, open[x]);
+    if (r == reach[x])
+      continue;
+    reach[x] = r;
+
+    /* Only revisit neighbouring columns that can gain cells from this one */
+    if (x > 0 && !queued[x - 1] && (r & open[x - 1] & ~reach[x - 1])) {
+      cols[n++] = x - 1;
+      queued[x - 1] = TRUE;
+    }
+    if (x < MAP_W - 1 && !queued[x + 1] &&
+        (r & open[x + 1] & ~reach[x + 1])) {
+      cols[n++] = x + 1;
+      queued[x + 1] = TRUE;
+    }
+  }
+
+  if (down && !(reach[lv->stxd] & ((uint64_t) 1 << lv->styd)))
+    return LEVEL_STAIRS_UNREACHABLE;
+
+  for (x = 0; x < MAP_W; x++)
+    if (reach[x] != open[x])
+      return LEVEL_DISCONNECTED;
+
+  return LEVEL_OK;
+}
+
+
+
+/*
+ * Dig and build a level from its seed, digging again until the level is
+ * valid.  Returns the number of attempts or 0 if no valid level was found.
+ */
+
+int generate_level(struct level *lv, rand_type seed, byte depth,
+                   byte map[MAP_W][MAP_H])
+{
+  int attempt;
+
+  seed_rand(level_seed(seed, depth));
+
+  for (attempt = 1; attempt <= MAX_LEVEL_ATTEMPTS; attempt++) {
+    dig_level(lv, depth);
+    build_level(lv, depth, map);
+    if (validate_level(lv, depth, map) == LEVEL_OK)
+      return attempt;
+  }
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+/******************************************************************************
+*   DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+*
+*   This file is part of yz.
+*   Copyright (C) 2014 Surplus Users Ham Society
+*
+*   Yz is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   Yz is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with Yz.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * validate.h -- level connectivity checks
+ * header for validate.c
+ */
+
+
+#ifndef _validate_h
+#define _validate_h
+
+#include <stdint.h>
+
+#include "dig.h"
+
+#if MAP_H > 64
+#error "validate.c needs one 64 bit mask per map column"
+#endif
+
+/* The bits of a column mask that lie on the map */
+#define COLUMN_BITS (~(uint64_t) 0 >> (64 - MAP_H))
+
+/* Result of validating a level */
+enum level_fault
+{
+  LEVEL_OK,
+  LEVEL_SHARED_STAIRS,
+  LEVEL_STAIRS_UNREACHABLE,
+  LEVEL_DISCONNECTED,
+  MAX_LEVEL_FAULT
+};
+
+/* Give up regenerating a level after this many attempts */
+#define MAX_LEVEL_ATTEMPTS 100
+
+extern const char *level_fault_names[MAX_LEVEL_FAULT];
+
+extern enum level_fault validate_level(const struct level *lv, byte depth,
+                                       byte map[MAP_W][MAP_H]);
+extern uint64_t match_column(const byte *col, byte c);
+extern int generate_level(struct level *lv, rand_type seed, byte depth,
+                          byte map[MAP_W][MAP_H]);
+
+#endif